@@ -0,0 +1,163 @@
+# Load necessary packages
+library(CoordinateCleaner)
+library(FasterCoordinateCleaner)
+library(callr)
+library(microbenchmark)
+library(ggplot2)
+library(dplyr)
+
+# Load the sample DataFrame with relevant columns
+input_file_path <- "/Users/Downloads/gbif_germany (1).rds"  # Ensure path is correct
+sample_data <- readRDS(input_file_path)
+
+# Reduce the size of the sample data to avoid memory issues
+sample_data <- sample_data[1:100000, ]  # Adjust the number of rows as needed
+
+# Select only the required columns
+sample_data <- sample_data[, c("decimalLongitude", "decimalLatitude", "species")]
+
+# Reference data shipped with CoordinateCleaner
+data("countryref", package = "CoordinateCleaner")
+data("institutions", package = "CoordinateCleaner")
+institutions <- institutions[!is.na(institutions$decimalLongitude) & !is.na(institutions$decimalLatitude), ]
+
+# The proximity tests only ask whether a record is within the buffer, so the
+# within-radius predicates decide most pairs from squared distances and a
+# latitude band. Each test is timed in its geodesic and planar form.
+proximity_tests <- list(
+  `cc_cap (geod)` = list(
+    original = function() CoordinateCleaner::cc_cap(sample_data, buffer = 10000, geod = TRUE,
+                                                    value = "flagged", verbose = FALSE),
+    faster = function() FasterCoordinateCleaner::cc_cap(sample_data, buffer = 10000, geod = TRUE,
+                                                         value = "flagged", verbose = FALSE)
+  ),
+  `cc_cap (planar)` = list(
+    original = function() CoordinateCleaner::cc_cap(sample_data, buffer = 0.1, geod = FALSE,
+                                                    value = "flagged", verbose = FALSE),
+    faster = function() FasterCoordinateCleaner::cc_cap(sample_data, buffer = 0.1, geod = FALSE,
+                                                         value = "flagged", verbose = FALSE)
+  ),
+  `cc_cen (geod)` = list(
+    original = function() CoordinateCleaner::cc_cen(sample_data, buffer = 1000, geod = TRUE,
+                                                    value = "flagged", verbose = FALSE),
+    faster = function() FasterCoordinateCleaner::cc_cen(sample_data, buffer = 1000, geod = TRUE,
+                                                         ref = countryref, value = "flagged", verbose = FALSE)
+  ),
+  `cc_inst (planar)` = list(
+    original = function() CoordinateCleaner::cc_inst(sample_data, buffer = 100, geod = FALSE,
+                                                     value = "flagged", verbose = FALSE),
+    faster = function() FasterCoordinateCleaner::cc_inst(sample_data, buffer = 100, geod = FALSE,
+                                                          ref = institutions, value = "flagged", verbose = FALSE)
+  ),
+  `cc_gbif (geod)` = list(
+    original = function() CoordinateCleaner::cc_gbif(sample_data, buffer = 1000, geod = TRUE,
+                                                     value = "flagged", verbose = FALSE),
+    faster = function() FasterCoordinateCleaner::cc_gbif(sample_data, buffer = 1000, geod = TRUE,
+                                                          value = "flagged", verbose = FALSE)
+  )
+)
+
+# Function to perform benchmarking
+run_benchmark <- function(test) {
+  microbenchmark(
+    CoordinateCleaner = {
+      gc()
+      test$original()
+    },
+    FasterCoordinateCleaner = {
+      gc()
+      test$faster()
+    },
+    times = 5
+  )
+}
+
+benchmarks <- lapply(proximity_tests, run_benchmark)
+
+# Print benchmarking results
+for (name in names(benchmarks)) {
+  cat("\n", name, "\n")
+  print(benchmarks[[name]])
+}
+
+# Plot the results
+benchmark_all <- bind_rows(lapply(names(benchmarks), function(name) {
+  mutate(as.data.frame(benchmarks[[name]]), test = name)
+}))
+
+ggplot(benchmark_all, aes(x = expr, y = time / 1e6, fill = expr)) +  # time is in nanoseconds, convert to milliseconds
+  geom_boxplot() +
+  facet_wrap(~ test, scales = "free_y") +
+  labs(title = "Benchmark: proximity tests, CoordinateCleaner vs FasterCoordinateCleaner (flagged)",
+       x = "Function",
+       y = "Execution Time (ms)") +
+  theme_minimal() +
+  scale_fill_manual(values = c("#FF9999", "#99CCFF"))
+
+# Compare the flags of both implementations
+for (name in names(proximity_tests)) {
+  flags_original <- proximity_tests[[name]]$original()
+  flags_faster <- proximity_tests[[name]]$faster()
+  cat(sprintf("%s: %s records flagged differently\n", name, sum(flags_original != flags_faster, na.rm = TRUE)))
+}
+
+# The same kernels before and after the predicate layer. Install the build
+# from before the change (the parent of the commit that added the
+# predicates) into its own library first, e.g. from the repository root:
+#   git worktree add ../fcc-baseline <commit>^
+#   R CMD INSTALL --library=/path/to/baseline-lib ../fcc-baseline
+# Both builds are called FasterCoordinateCleaner, so each one is loaded in its
+# own R process.
+baseline_lib <- Sys.getenv("CC_BASELINE_LIB")  # Library holding the build before the change
+current_lib <- .libPaths()[1]                  # Library holding the build under test
+if (!nzchar(baseline_lib)) {
+  stop("Set CC_BASELINE_LIB to the library holding the baseline build")
+}
+
+# Time one test with the build installed in lib, in a fresh R process. The
+# test closes over the sample and reference data, which travel with it.
+run_build <- function(lib, kernel) {
+  callr::r(function(lib, kernel) {
+    library(FasterCoordinateCleaner, lib.loc = lib)
+    flags <- kernel()
+    times <- microbenchmark::microbenchmark(kernel(), times = 5)$time
+    list(times = times, flags = flags)
+  }, args = list(lib = lib, kernel = kernel), libpath = c(lib, .libPaths()))
+}
+
+builds <- c(before = baseline_lib, after = current_lib)
+build_results <- lapply(proximity_tests, function(test) {
+  kernel <- test$faster
+  environment(kernel) <- list2env(list(sample_data = sample_data, countryref = countryref,
+                                       institutions = institutions))
+  lapply(builds, run_build, kernel = kernel)
+})
+
+build_all <- bind_rows(lapply(names(build_results), function(name) {
+  bind_rows(lapply(names(builds), function(build) {
+    data.frame(test = name, build = build, time = build_results[[name]][[build]]$times)
+  }))
+}))
+build_all$build <- factor(build_all$build, levels = names(builds))
+
+# Print benchmarking results
+build_all %>%
+  group_by(test, build) %>%
+  summarise(median_ms = median(time) / 1e6, .groups = "drop") %>%
+  print(n = Inf)
+
+# Plot the results
+ggplot(build_all, aes(x = build, y = time / 1e6, fill = build)) +  # time is in nanoseconds, convert to milliseconds
+  geom_boxplot() +
+  facet_wrap(~ test, scales = "free_y") +
+  labs(title = "Benchmark: proximity tests before and after the within-radius predicates (flagged)",
+       x = "Build",
+       y = "Execution Time (ms)") +
+  theme_minimal() +
+  scale_fill_manual(values = c("#FF9999", "#99CCFF"))
+
+# The predicates must not change any flag
+for (name in names(build_results)) {
+  differing <- sum(build_results[[name]]$before$flags != build_results[[name]]$after$flags, na.rm = TRUE)
+  cat(sprintf("%s: %s records flagged differently before and after\n", name, differing))
+}
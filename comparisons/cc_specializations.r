@@ -0,0 +1,117 @@
+# Load necessary packages
+library(callr)
+library(ggplot2)
+library(dplyr)
+
+# The specialized kernels are timed against the build from before the
+# specialization (the parent of the commit that added it). Install that build
+# into its own library first, e.g. from the repository root:
+#   git worktree add ../fcc-baseline <commit>^
+#   R CMD INSTALL --library=/path/to/baseline-lib ../fcc-baseline
+# Both builds are called FasterCoordinateCleaner, so each one is loaded in its
+# own R process.
+baseline_lib <- Sys.getenv("CC_BASELINE_LIB")  # Library holding the build before the change
+current_lib <- .libPaths()[1]                  # Library holding the build under test
+if (!nzchar(baseline_lib)) {
+  stop("Set CC_BASELINE_LIB to the library holding the baseline build")
+}
+
+# Load the sample DataFrame with relevant columns
+input_file_path <- "/Users/Downloads/gbif_germany (1).rds"  # Ensure path is correct
+sample_data <- readRDS(input_file_path)
+
+# Reduce the size of the sample data to avoid memory issues
+sample_data <- sample_data[1:100000, ]  # Adjust the number of rows as needed
+
+# Select only the required columns
+sample_data <- sample_data[, c("decimalLongitude", "decimalLatitude", "species")]
+
+# Reference data
+data("institutions", package = "CoordinateCleaner")
+institutions <- institutions[!is.na(institutions$decimalLongitude) & !is.na(institutions$decimalLatitude), ]
+
+# Species range polygons from an independent source (e.g. IUCN range maps),
+# with a column naming the species
+range_file_path <- Sys.getenv("CC_RANGE_LAYER")  # Path to a polygon layer readable by terra
+if (!nzchar(range_file_path)) {
+  stop("Set CC_RANGE_LAYER to a species range polygon layer")
+}
+range_polygons <- terra::vect(range_file_path)
+if ("binomial" %in% names(range_polygons) & !"species" %in% names(range_polygons)) {
+  names(range_polygons)[names(range_polygons) == "binomial"] <- "species"
+}
+range_polygons <- terra::subset(range_polygons, range_polygons$species %in% sample_data$species)
+
+# One bounding box per species, from the extent of its range polygons
+range_boxes <- lapply(terra::split(range_polygons, "species"), function(r) {
+  e <- as.vector(terra::ext(r))
+  list(species = r$species[1],
+       min_lon = e[["xmin"]], min_lat = e[["ymin"]],
+       max_lon = e[["xmax"]], max_lat = e[["ymax"]])
+})
+range_boxes <- unname(range_boxes)
+
+# Each kernel is compiled once per metric or range kind and picks the variant
+# once per call; time every variant on its own
+specializations <- list(
+  `cc_cap geodesic` = function(x, inst, boxes, ranges)
+    FasterCoordinateCleaner::cc_cap(x, buffer = 10000, geod = TRUE, value = "flagged", verbose = FALSE),
+  `cc_cap planar` = function(x, inst, boxes, ranges)
+    FasterCoordinateCleaner::cc_cap(x, buffer = 0.1, geod = FALSE, value = "flagged", verbose = FALSE),
+  `cc_inst geodesic` = function(x, inst, boxes, ranges)
+    FasterCoordinateCleaner::cc_inst(x, buffer = 100, geod = TRUE, ref = inst, value = "flagged", verbose = FALSE),
+  `cc_inst planar` = function(x, inst, boxes, ranges)
+    FasterCoordinateCleaner::cc_inst(x, buffer = 0.001, geod = FALSE, ref = inst, value = "flagged", verbose = FALSE),
+  `cc_iucn boxes` = function(x, inst, boxes, ranges)
+    FasterCoordinateCleaner:::cc_iucn_cpp(x, boxes, buffer = 1000, value = "flagged", verbose = FALSE)$flags,
+  `cc_iucn polygons` = function(x, inst, boxes, ranges)
+    FasterCoordinateCleaner::cc_iucn(x, terra::vect(ranges), buffer = 0, value = "flagged", verbose = FALSE),
+  `cc_iucn polygons with buffer` = function(x, inst, boxes, ranges)
+    FasterCoordinateCleaner::cc_iucn(x, terra::vect(ranges), buffer = 1000, value = "flagged", verbose = FALSE)
+)
+
+# Time one variant with the build installed in lib, in a fresh R process.
+# SpatVectors cannot cross processes, so the ranges travel as well-known text.
+run_benchmark <- function(lib, kernel) {
+  callr::r(function(lib, kernel, x, inst, boxes, ranges) {
+    library(FasterCoordinateCleaner, lib.loc = lib)
+    flags <- kernel(x, inst, boxes, ranges)
+    times <- microbenchmark::microbenchmark(kernel(x, inst, boxes, ranges), times = 5)$time
+    list(times = times, flags = flags)
+  }, args = list(lib = lib, kernel = kernel, x = sample_data, inst = institutions, boxes = range_boxes,
+                 ranges = terra::wrap(range_polygons)),
+  libpath = c(lib, .libPaths()))
+}
+
+builds <- c(before = baseline_lib, after = current_lib)
+results <- lapply(specializations, function(kernel) lapply(builds, run_benchmark, kernel = kernel))
+
+benchmark_all <- bind_rows(lapply(names(results), function(name) {
+  bind_rows(lapply(names(builds), function(build) {
+    data.frame(test = name, build = build, time = results[[name]][[build]]$times)
+  }))
+}))
+benchmark_all$build <- factor(benchmark_all$build, levels = names(builds))
+
+# Print benchmarking results
+benchmark_all %>%
+  group_by(test, build) %>%
+  summarise(median_ms = median(time) / 1e6, ns_per_record = median(time) / nrow(sample_data),
+            .groups = "drop") %>%
+  print(n = Inf)
+
+# Plot the results
+ggplot(benchmark_all, aes(x = build, y = time / 1e6, fill = build)) +  # time is in nanoseconds, convert to milliseconds
+  geom_boxplot() +
+  facet_wrap(~ test, scales = "free_y") +
+  labs(title = "Benchmark: FasterCoordinateCleaner kernels before and after specialization (flagged)",
+       x = "Build",
+       y = "Execution Time (ms)") +
+  theme_minimal() +
+  scale_fill_manual(values = c("#FF9999", "#99CCFF"))
+
+# The specialization must not change any flag
+for (name in names(results)) {
+  differing <- sum(results[[name]]$before$flags != results[[name]]$after$flags, na.rm = TRUE)
+  cat(sprintf("%s: %s records flagged differently\n", name, differing))
+}
@@ -0,0 +1,38 @@
+#' Build a Reusable Reference Index
+#'
+#' Converts a reference data set into a native index once, so repeated
+#' calls to the cleaning functions (for example per data chunk) do not have to
+#' re-read the reference data. The returned handle can be passed to the
+#' matching test wherever it accepts raw reference data.
+#'
+#' @param type The kind of reference: "capitals", "centroids", "institutions",
+#'   "seas", "urban", "range" or "countries".
+#' @param ref The reference data, in the same form the matching test takes:
+#'   a matrix or data.frame of coordinates for point references (for
+#'   "centroids" optionally with a \code{type} column of "country" or
+#'   "province"), a list of
+#'   polygon matrices for "seas" and "urban", a list of species ranges for
+#'   "range" (each a list with \code{species} and either \code{min_lon},
+#'   \code{min_lat}, \code{max_lon}, \code{max_lat} or \code{polygons}, a list
+#'   of polygons given as lists of rings, exterior first), and for "countries"
+#'   either a data.frame of centroids with ISO3 codes or a list of countries,
+#'   each a list with \code{iso3} and \code{polygons} as for "range".
+#'
+#' @return An external pointer of class \code{cc_reference}. It is only valid
+#'   within the R session that created it.
+#' @export
+#' @importFrom Rcpp sourceCpp
+#' @useDynLib FasterCoordinateCleaner
+cc_build_reference <- function(type, ref) {
+
+  match.arg(type, choices = c("capitals", "centroids", "institutions",
+                              "seas", "urban", "range", "countries"))
+
+  cc_build_reference_cpp(type, ref)
+}
+
+#' @export
+print.cc_reference <- function(x, ...) {
+  cat(sprintf("<cc_reference: %s>\n", attr(x, "type")))
+  invisible(x)
+}
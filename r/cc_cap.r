@@ -1,6 +1,7 @@
 #' @name cc_cap
 #' @title Capital City Check Function
-#' @param ref data.frame. Providing the reference coordinates for capital cities.
+#' @param ref data.frame. Providing the reference coordinates for capital cities,
+#'   or a handle from \code{cc_build_reference("capitals", ...)}.
 #'   If NULL, uses the built-in reference data.
 #' @param verify logical. If TRUE, records are flagged only if they are the only
 #'   flagged record for a given species. Default is FALSE.
@@ -8,6 +9,7 @@
 #'   a data.frame with problematic records removed, or "flagged" to return a logical
 #'   vector. Default = "clean".
 #' @param verbose logical. If TRUE, prints messages during execution.
+#' @param nthreads Number of threads to use; 0 uses all available cores. Default is 1.
 #'
 #' @return Depending on the `value` argument, either a `data.frame`
 #'   containing the records considered correct by the test ("clean") or a
@@ -24,7 +26,8 @@ cc_cap <- function(x,
                    ref = NULL,
                    verify = FALSE,
                    value = "clean",
-                   verbose = TRUE) {
+                   verbose = TRUE,
+                   nthreads = 1) {
 
   # Input validation
   if (!is.data.frame(x)) {
@@ -45,20 +48,15 @@ cc_cap <- function(x,
     stop("Longitude and/or latitude columns not found in the dataset")
   }
 
-  # Convert coordinates to matrix
-  points <- try(as.matrix(x[, c(lon, lat)]), silent = TRUE)
-  if (inherits(points, "try-error")) {
-    stop("Could not convert coordinates to numeric matrix")
-  }
-
-  # Handle missing or invalid coordinates
-  if (any(is.na(points))) {
+  # Coordinates are read in place; missing ones are never near a capital
+  if (anyNA(x[[lon]]) || anyNA(x[[lat]])) {
     warning("Dataset contains missing coordinates")
-    points[is.na(points)] <- 0  # Replace NA with 0 for processing
   }
 
   # Load reference data
-  if (is.null(ref)) {
+  if (inherits(ref, "cc_reference")) {
+    ref_coords <- ref
+  } else if (is.null(ref)) {
     ref_data_path <- system.file("data", "countryref.rda",
                                  package = "FasterCoordinateCleaner")
     if (!file.exists(ref_data_path)) {
@@ -80,10 +78,13 @@ cc_cap <- function(x,
   }
 
   # Call the C++ function for fast distance computation
-  flagged <- try(cc_cap_cpp(points = points,
+  flagged <- try(cc_cap_cpp(points = x,
                             buffer = buffer,
                             geod = geod,
-                            ref_coords = ref_coords), silent = TRUE)
+                            ref_coords = ref_coords,
+                            nthreads = nthreads,
+                            lon_col = lon,
+                            lat_col = lat), silent = TRUE)
 
   if (inherits(flagged, "try-error")) {
     stop("Error in C++ computation. Check input data format")
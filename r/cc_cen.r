@@ -8,9 +8,12 @@
 #' @param species character string. The column with the species identity.
 #' @param buffer numeric. The buffer around each centroid, where records should be flagged as problematic. Default = 10000 (10 km).
 #' @param geod logical. If TRUE, the radius around each centroid is calculated based on a sphere, buffer is in meters and independent of latitude. If FALSE, the radius is calculated assuming planar coordinates.
-#' @param ref data.frame. Providing the reference coordinates for centroids. If NULL, uses the built-in reference data.
+#' @param test character string. Which centroids to test against: "country", "provinces" or "both". Reference centroids are told apart by a `type` column ("country" or "province"); without one, all of them are used. Default = "both".
+#' @param ref data.frame. Providing the reference coordinates for centroids, or a handle from \code{cc_build_reference("centroids", ...)}. If NULL, uses the built-in reference data.
+#' @param verify logical. If TRUE, flagged records are kept when another record has exactly the same coordinates. Default = FALSE.
 #' @param value character string. Defining the output value.
 #' @param verbose logical. If TRUE, reports the name of the test and the number of records flagged.
+#' @param nthreads Number of threads to use; 0 uses all available cores. Default is 1.
 #'
 #' @return Depending on the `value` argument, either a `data.frame` containing the records considered correct by the test ("clean") or a logical vector ("flagged").
 #' @export
@@ -20,9 +23,12 @@ cc_cen <- function(x,
                    species = "species",
                    buffer = 10000,
                    geod = TRUE,
+                   test = "both",
                    ref = NULL, 
+                   verify = FALSE,
                    value = "clean", 
-                   verbose = TRUE) {
+                   verbose = TRUE,
+                   nthreads = 1) {
   
   if (verbose) {
     message("Testing country centroids")
@@ -42,23 +48,28 @@ cc_cen <- function(x,
   
   # Drop unused columns
   x <- drop_unused_columns(x, lon = lon, lat = lat, species = species, country = "countryCode")
-  points <- as.matrix(x[, c(lon, lat)])
   
   # Load optimized .rds reference data
-  if (is.null(ref)) {
+  if (inherits(ref, "cc_reference")) {
+    ref_coords <- ref
+  } else if (is.null(ref)) {
     ref_data_path <- "/Users/njord888/Desktop/Myco_PKGs/New_Package/FasterCoordinateCleaner.Rcheck/00_pkg_src/FasterCoordinateCleaner/data/country_reference_crop.rds"
     if (!file.exists(ref_data_path)) {
       stop("Country reference .rds file not found. Please provide 'ref' argument.")
     }
     # Load the reference data from the .rds file
     ref_data <- readRDS(ref_data_path)
-    ref_coords <- as.matrix(ref_data[, c("centroid.lon", "centroid.lat")])
+    ref_coords <- ref_data
+  } else if (all(c(lon, lat) %in% names(ref))) {
+    ref_coords <- data.frame(centroid.lon = ref[[lon]], centroid.lat = ref[[lat]])
+    if ("type" %in% names(ref)) ref_coords$type <- ref$type
   } else {
-    ref_coords <- as.matrix(ref[, c(lon, lat)])
+    ref_coords <- ref
   }
   
   # Call the C++ function for distance checking
-  out <- cc_cen_cpp(points, ref_coords, buffer, geod)
+  out <- cc_cen_cpp(x, lon, lat, species, buffer, geod, test, ref_coords,
+                    verify, "flagged", FALSE, nthreads)
   
   if (verbose) {
     if (value == "clean") {
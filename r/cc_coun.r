@@ -5,10 +5,13 @@
 #' @param lat The name of the latitude column. Default is "decimalLatitude".
 #' @param iso3 The name of the country code column. Default is "countrycode".
 #' @param value The return value type, either "clean" or "flagged". Default is "clean".
-#' @param ref A SpatVector object representing the reference country polygons. Default is NULL.
+#' @param ref A SpatVector object representing the reference country polygons, or a handle from
+#'   \code{cc_build_reference("countries", ...)}. Default is NULL.
 #' @param ref_col The column name in the reference dataset containing the ISO codes. Default is "iso_a3".
 #' @param verbose Logical, whether to print messages. Default is TRUE.
-#' @param buffer Numeric, the buffer distance in meters. Default is NULL.
+#' @param buffer Numeric, the buffer distance in meters: records this close to their country's
+#'   border still count as inside it. Default is NULL (no buffer).
+#' @param nthreads Number of threads to use; 0 uses all available cores. Default is 1.
 #'
 #' @return A data.frame of cleaned coordinates or a logical vector of flags.
 #' @export
@@ -22,7 +25,8 @@ cc_coun <- function(x,
                     ref = NULL, 
                     ref_col = "iso_a3",
                     verbose = TRUE,
-                    buffer = NULL) {
+                    buffer = NULL,
+                    nthreads = 1) {
   
   if (!iso3 %in% names(x)) {
     stop("iso3 argument missing, please specify")
@@ -32,27 +36,45 @@ cc_coun <- function(x,
     message("Testing country identity")
   }
   
-  if (is.null(ref)) {
-    if (!requireNamespace("rnaturalearth", quietly = TRUE)) {
-      stop("Install the 'rnaturalearth' package or provide a custom reference", call. = FALSE)
-    }
-    ref <- terra::vect(rnaturalearth::ne_countries(scale = "medium", returnclass = "sf"))
+  if (inherits(ref, "cc_reference")) {
+    countries <- ref
   } else {
-    if (any(is(ref) == "Spatial") | inherits(ref, "sf")) {
-      ref <- terra::vect(ref)
-    }
-    if (!(inherits(ref, "SpatVector") & terra::geomtype(ref) == "polygons")) {
-      stop("ref must be a SpatVector with geomtype 'polygons'")
+    if (is.null(ref)) {
+      if (!requireNamespace("rnaturalearth", quietly = TRUE)) {
+        stop("Install the 'rnaturalearth' package or provide a custom reference", call. = FALSE)
+      }
+      ref <- terra::vect(rnaturalearth::ne_countries(scale = "medium", returnclass = "sf"))
+    } else {
+      if (any(is(ref) == "Spatial") | inherits(ref, "sf")) {
+        ref <- terra::vect(ref)
+      }
+      if (!(inherits(ref, "SpatVector") & terra::geomtype(ref) == "polygons")) {
+        stop("ref must be a SpatVector with geomtype 'polygons'")
+      }
+      ref <- reproj(ref)
     }
-    ref <- reproj(ref)
+    
+    # One entry per country feature: its ISO3 code and its polygons, each a
+    # list of rings (the exterior and its holes) as lon/lat matrices
+    geom <- terra::geom(ref)
+    ref_iso3 <- as.character(ref[[ref_col]][, 1])
+    countries <- lapply(split(seq_len(nrow(geom)), geom[, "geom"]), function(f) {
+      polygons <- lapply(split(f, geom[f, "part"]), function(p) {
+        unname(lapply(split(p, geom[p, "hole"]), function(h) geom[h, c("x", "y"), drop = FALSE]))
+      })
+      list(iso3 = ref_iso3[geom[f[1], "geom"]], polygons = unname(polygons))
+    })
+    countries <- unname(countries)
   }
   
-  points <- as.matrix(x[, c(lon, lat)])
-  iso3_codes <- as.character(x[[iso3]])
-  ref_coords <- as.matrix(terra::geom(ref)[, c("x", "y")])
-  ref_iso3 <- as.character(ref[[ref_col]])
+  if (is.null(buffer)) {
+    buffer <- 0
+  }
+  points <- x[, c(lon, lat)]
+  points[[iso3]] <- as.character(x[[iso3]])
   
-  result <- cc_coun_cpp(points, iso3_codes, ref_coords, ref_iso3, buffer)
+  result <- cc_coun_cpp(points, lon, lat, iso3, countries, buffer = buffer, value = "flagged",
+                        verbose = FALSE, nthreads = nthreads)$flagged
   
   if (verbose) {
     if (value == "clean") {
@@ -7,6 +7,11 @@
 #' @param additions A vector of character strings for additional columns. Default is NULL.
 #' @param value The return value type, either "clean" or "flagged". Default is "clean".
 #' @param verbose Logical, whether to print messages. Default is TRUE.
+#' @param nthreads Number of threads to use; 0 uses all available cores. Default is 1.
+#'
+#' @details Records are compared on the exact values of their coordinates (0 and -0, and all NAs,
+#'   count as equal, as in \code{duplicated()}) and on the text of the species and additional columns.
+#'   The first occurrence of each record is kept.
 #'
 #' @return A data.frame of cleaned coordinates or a logical vector of flags.
 #' @export
@@ -18,7 +23,8 @@ cc_dupl <- function(x,
                     species = "species",
                     additions = NULL,
                     value = "clean",
-                    verbose = TRUE) {
+                    verbose = TRUE,
+                    nthreads = 1) {
 
   if (verbose) {
     message("Testing duplicates")
@@ -35,7 +41,7 @@ cc_dupl <- function(x,
     }
   }
 
-  result <- cc_dupl_cpp(lon_col, lat_col, species_col, additions_list)
+  result <- cc_dupl_cpp(lon_col, lat_col, species_col, additions_list, nthreads)
 
   if (verbose) {
     if(value == "clean"){
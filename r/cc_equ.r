@@ -10,6 +10,7 @@
 #' @param test A character string defining if coordinates are compared exactly ("identical") or on the absolute scale ("absolute"). Default is "absolute".
 #' @param value The return value type, either "clean" or "flagged". Default is "clean".
 #' @param verbose Logical, whether to print messages. Default is TRUE.
+#' @param nthreads Number of threads to use; 0 uses all available cores. Default is 1.
 #'
 #' @return A data.frame of cleaned coordinates or a logical vector of flags.
 #' @export
@@ -20,7 +21,8 @@ cc_equ <- function(x,
                    lat = "decimalLatitude",
                    test = "absolute",
                    value = "clean",
-                   verbose = TRUE) {
+                   verbose = TRUE,
+                   nthreads = 1) {
 
   match.arg(test, choices = c("absolute", "identical"))
   match.arg(value, choices = c("clean", "flagged"))
@@ -32,7 +34,7 @@ cc_equ <- function(x,
   lon_col <- x[[lon]]
   lat_col <- x[[lat]]
 
-  result <- cc_equ_cpp(lon_col, lat_col, test)
+  result <- cc_equ_cpp(lon_col, lat_col, test, nthreads)
 
   if (verbose) {
     if (value == "clean"){
@@ -0,0 +1,54 @@
+#' Packed Test Flags
+#' @name cc_flags
+#' @title Read flags returned by `clean_coordinates(output = "packed")`
+#' @description `clean_coordinates(output = "packed")` keeps its flags packed, one bit per test and record.
+#'   These functions unpack only what is asked for: the flags of one test, the records that passed every test,
+#'   or their row numbers.
+#'
+#' @param flags The `results` element returned by `clean_coordinates(output = "packed")`, of class `cc_flags`.
+#' @param test Name of a test that was run.
+#' @param x Flags of class `cc_flags`.
+#' @param ... Unused.
+#'
+#' @return `cc_flags_test()` returns a logical vector, `NA` where a short-circuited test skipped a record;
+#'   `cc_flags_summary()` returns a logical vector, `TRUE` for the records that passed every test they were
+#'   given and never `NA`; `cc_flags_rows()` returns the row numbers of those records, which subset the data
+#'   lazily as `x[cc_flags_rows(flags), ]`; `as.matrix()` unpacks every test, with `NA` as in
+#'   `cc_flags_test()`.
+#' @examples
+#' \dontrun{
+#' result <- clean_coordinates(sample_data, tests = c("equal", "zeros"), output = "packed")
+#' zeros <- cc_flags_test(result$results, "zeros")
+#' clean <- sample_data[result$clean, ]
+#' }
+NULL
+
+#' @rdname cc_flags
+#' @export
+cc_flags_test <- function(flags, test) {
+  cc_flags_test_cpp(flags, test)
+}
+
+#' @rdname cc_flags
+#' @export
+cc_flags_summary <- function(flags) {
+  cc_flags_summary_cpp(flags)
+}
+
+#' @rdname cc_flags
+#' @export
+cc_flags_rows <- function(flags) {
+  cc_flags_rows_cpp(flags)
+}
+
+#' @rdname cc_flags
+#' @export
+as.matrix.cc_flags <- function(x, ...) {
+  cc_flags_matrix_cpp(x)
+}
+
+#' @export
+print.cc_flags <- function(x, ...) {
+  cat(sprintf("<cc_flags: %s records x %s tests>\n", format(attr(x, "n")), length(attr(x, "tests"))))
+  invisible(x)
+}
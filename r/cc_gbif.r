@@ -9,6 +9,7 @@
 #' @param verify Logical, whether to verify the results. Default is FALSE.
 #' @param value The return value type, either "clean" or "flagged". Default is "clean".
 #' @param verbose Logical, whether to print messages. Default is TRUE.
+#' @param nthreads Number of threads to use; 0 uses all available cores. Default is 1.
 #'
 #' @return A data.frame of cleaned coordinates or a logical vector of flags.
 #' @export
@@ -22,7 +23,8 @@ cc_gbif <- function(x,
                     geod = TRUE,
                     verify = FALSE,
                     value = "clean",
-                    verbose = TRUE) {
+                    verbose = TRUE,
+                    nthreads = 1) {
 
   match.arg(value, choices = c("clean", "flagged"))
 
@@ -40,7 +42,7 @@ cc_gbif <- function(x,
   lon_col <- x[[lon]]
   lat_col <- x[[lat]]
 
-  result <- cc_gbif_cpp(lon_col, lat_col, buffer, geod)
+  result <- cc_gbif_cpp(lon_col, lat_col, buffer, geod, nthreads = nthreads)
 
   if (verbose) {
     if(value == "clean") {
@@ -6,11 +6,13 @@
 #' @param species The name of the species column. Default is "species".
 #' @param buffer The buffer distance in meters. Default is 100.
 #' @param geod Logical, whether to use geodetic calculations. Default is FALSE.
-#' @param ref A SpatVector object representing the reference biodiversity institutions. Default is NULL.
+#' @param ref A SpatVector object representing the reference biodiversity institutions,
+#'   or a handle from \code{cc_build_reference("institutions", ...)}. Default is NULL.
 #' @param verify Logical, whether to verify the results. Default is FALSE.
 #' @param verify_mltpl Numerical, factor by which the verify buffer exceeds the initial buffer. Default is 10.
 #' @param value The return value type, either "clean" or "flagged". Default is "clean".
 #' @param verbose Logical, whether to print messages. Default is TRUE.
+#' @param nthreads Number of threads to use; 0 uses all available cores. Default is 1.
 #'
 #' @return A data.frame of cleaned coordinates or a logical vector of flags.
 #' @export
@@ -26,7 +28,8 @@ cc_inst <- function(x,
                     verify = FALSE,
                     verify_mltpl = 10,
                     value = "clean",
-                    verbose = TRUE) {
+                    verbose = TRUE,
+                    nthreads = 1) {
 
   match.arg(value, choices = c("clean", "flagged"))
 
@@ -41,58 +44,29 @@ cc_inst <- function(x,
     warning("Using small buffer, check 'geod'")
   }
 
-  lon_col <- x[[lon]]
-  lat_col <- x[[lat]]
+  if (verify && !species %in% names(x)) {
+    stop("Species column not found in dataset")
+  }
 
   if (is.null(ref)) {
     ref <- CoordinateCleaner::institutions
     ref <- ref[!is.na(ref$decimalLongitude) & !is.na(ref$decimalLatitude), ]
   }
 
-  ref_coords <- as.matrix(ref[, c("decimalLongitude", "decimalLatitude")])
-
-  result <- cc_inst_cpp(lon_col, lat_col, ref_coords, buffer, geod)
-
-  if (verify) {
-    ref_in <- x[!result, ]
-
-    if (nrow(ref_in) > 0) {
-      if (geod) {
-        dg <- seq(from = 0, to = 360, by = 5)
-
-        buff_XY <- geosphere::destPoint(p = ref_in[, c(lon, lat)],
-                                        b = rep(dg, each = nrow(ref_in)),
-                                        d = buffer * verify_mltpl)
-
-        id <- rep(seq(from = 1, to = nrow(ref_in)), times = length(dg))
-        lst <- split(data.frame(buff_XY), f = id)
-
-        lst <- lapply(lst, as.matrix)
-        poly <- lapply(lst, terra::vect, crs = wgs84, type = "polygons")
-        ref <- terra::vect(ref)
-
-        ref$species <- ref_in[, species]
-      } else {
-        ref <- terra::vect(ref_in, geom = c(lon, lat))
-        ref <- terra::buffer(ref, width = buffer * verify_mltpl)
-        ref$species <- ref_in[, species]
-      }
-
-      f_spec <- x[x[, species] %in% ref$species, ]
-
-      dbch_flag <- logical(nrow(ref_in))
-
-      for (i in seq_len(nrow(ref_in))) {
-        dbch <- terra::extract(terra::vect(f_spec[unlist(f_spec[species]) == ref$species[i], ], geom = c(lon, lat), crs = wgs84),
-                               terra::subset(ref, seq_len(length(ref)) == i))
-
-        dbch_flag[i] <- sum(!is.na(dbch$species)) > nrow(ref_in[ref_in[[species]] == ref_in[[i, species]] & ref_in[[lon]] ==  ref_in[[i, lon]] & ref_in[[lat]] ==  ref_in[[i, lat]], ])
-      }
-
-      result[rownames(ref_in)] <- unlist(dbch_flag)
-    }
+  # A handle carries its own coordinates
+  if (inherits(ref, "cc_reference")) {
+    ref_lon <- ref
+    ref_lat <- NULL
+  } else {
+    ref_lon <- ref$decimalLongitude
+    ref_lat <- ref$decimalLatitude
   }
 
+  # Verification runs natively: a flagged record is kept if another record of
+  # its species lies within buffer * verify_mltpl
+  result <- cc_inst_cpp(x, ref_lon, ref_lat, lon, lat, species, buffer, geod, verify, verify_mltpl,
+                        value = "flagged", verbose = verbose, nthreads = nthreads)$flags
+
   if (verbose) {
     if (value == "clean") {
       message(sprintf("Removed %s records.", sum(!result)))
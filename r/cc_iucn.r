@@ -1,13 +1,19 @@
 #' cc_iucn Rcpp Wrapper
 #'
 #' @param x A data.frame containing coordinates.
-#' @param range A SpatVector of natural ranges for species.
+#' @param range A SpatVector of natural ranges for species, or a handle from
+#'   \code{cc_build_reference("range", ...)}. Range polygons may have holes.
 #' @param lon The name of the longitude column. Default is "decimalLongitude".
 #' @param lat The name of the latitude column. Default is "decimalLatitude".
 #' @param species The name of the species column. Default is "species".
-#' @param buffer The buffer distance in meters. Default is 0.
+#' @param buffer The buffer distance in meters. Records within this distance of a species' range
+#'   polygon edge count as inside it. The distance is approximate: it is measured in an equirectangular
+#'   projection centred on each record, which is close for buffers of up to a few hundred kilometres away
+#'   from the poles. Bounding-box ranges are widened by the buffer, with the longitude margin scaled by
+#'   1/cos(latitude) at the box edge nearest a pole. Default is 0.
 #' @param value The return value type, either "clean" or "flagged". Default is "clean".
 #' @param verbose Logical, whether to print messages. Default is TRUE.
+#' @param nthreads Number of threads to use; 0 uses all available cores. Default is 1.
 #'
 #' @return A data.frame of cleaned coordinates or a logical vector of flags.
 #' @export
@@ -20,7 +26,8 @@ cc_iucn <- function(x,
                     species = "species",
                     buffer = 0,
                     value = "clean",
-                    verbose = TRUE){
+                    verbose = TRUE,
+                    nthreads = 1){
 
   match.arg(value, choices = c("clean", "flagged"))
 
@@ -28,28 +35,37 @@ cc_iucn <- function(x,
     message("Testing natural ranges")
   }
 
-  if (any(is(range) == "Spatial") | inherits(range, "sf")) {
-    range <- terra::vect(range)
-  }
-  if (!(inherits(range, "SpatVector") & terra::geomtype(range) == "polygons")) {
-    stop("ref must be a SpatVector with geomtype 'polygons'")
-  }
-
-  if ("binomial" %in% names(range) & !species %in% names(range) & species %in% names(x)) {
-    names(range)[names(range) == "binomial"] <- species
-  }
+  if (inherits(range, "cc_reference")) {
+    ranges <- range
+  } else {
+    if (any(is(range) == "Spatial") | inherits(range, "sf")) {
+      range <- terra::vect(range)
+    }
+    if (!(inherits(range, "SpatVector") & terra::geomtype(range) == "polygons")) {
+      stop("ref must be a SpatVector with geomtype 'polygons'")
+    }
 
-  test_range <- range[[species]][, 1] %in% unique(unlist(x[, species]))
-  range <- terra::subset(range, test_range)
+    if ("binomial" %in% names(range) & !species %in% names(range) & species %in% names(x)) {
+      names(range)[names(range) == "binomial"] <- species
+    }
 
-  points <- as.matrix(x[, c(lon, lat)])
-  species_col <- x[[species]]
+    test_range <- range[[species]][, 1] %in% unique(unlist(x[, species]))
+    range <- terra::subset(range, test_range)
 
-  ranges <- lapply(split(range, range[[species]]), function(r) {
-    list(coords = as.matrix(terra::geom(r)[, c("x", "y")]), species = unique(r[[species]]))
-  })
+    # One entry per species: its polygons, each a list of rings (the exterior
+    # and its holes) as lon/lat matrices
+    ranges <- lapply(terra::split(range, species), function(r) {
+      g <- terra::geom(r)
+      parts <- split(seq_len(nrow(g)), paste(g[, "geom"], g[, "part"]))
+      polygons <- lapply(parts, function(p) {
+        unname(lapply(split(p, g[p, "hole"]), function(h) g[h, c("x", "y"), drop = FALSE]))
+      })
+      list(species = r[[species]][1, 1], polygons = unname(polygons))
+    })
+  }
 
-  result <- cc_iucn_cpp(points, species_col, ranges, buffer)
+  result <- cc_iucn_cpp(x, ranges, lon, lat, species, buffer, value = "flagged",
+                        verbose = FALSE, nthreads = nthreads)$flags
 
   if (verbose) {
     if(value == "clean") {
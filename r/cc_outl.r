@@ -1,19 +1,28 @@
 #' Identify Geographic Outliers in Species Distributions
 #'
 #' Flags geographic outliers in species distributions based on specified methods:
-#' "quantile", "mad", "distance", or "intrinsic" for intrinsic vectorization.
+#' "quantile", "mad", or "distance".
+#'
+#' "quantile" and "mad" compare the mean distance of each record to the other records of its
+#' species, which takes time quadratic in the number of records of a species (about 10^10 distances
+#' for a species of 100,000 records). Set \code{sampling_thresh} to bound it for large species.
 #'
 #' @param x A data frame containing species records.
 #' @param lon The column name for longitude. Default is "decimalLongitude".
 #' @param lat The column name for latitude. Default is "decimalLatitude".
 #' @param species The column name for species. Default is "species".
-#' @param method The method for outlier detection: "quantile", "mad", "distance", or "intrinsic".
+#' @param method The method for outlier detection: "quantile", "mad", or "distance".
 #' @param mltpl Multiplier for IQR or MAD. Default is 5.
 #' @param tdi Threshold distance for "distance" method. Default is 1000.
 #' @param min_occs Minimum number of occurrences required for testing. Default is 7.
 #' @param value The return value type: "clean", "flagged", or "ids". Default is "clean".
 #' @param verbose Whether to display messages. Default is TRUE.
-#' @param intrinsic Whether to use intrinsic vectorization for large datasets.
+#' @param intrinsic Deprecated. Distances are never held in a matrix, so it has no effect; \code{TRUE} gives
+#'   a warning.
+#' @param sampling_thresh For "quantile" and "mad": species with more records than this have each record's
+#'   mean distance computed against \code{sampling_thresh} records spread over the species instead of all of
+#'   them, which approximates the statistic in linear time. 0 (the default) always uses all records.
+#' @param nthreads Number of threads to use; 0 uses all available cores. Default is 1.
 #'
 #' @return A cleaned data frame, logical vector, or vector of row indices depending on \code{value}.
 #' @export
@@ -28,10 +37,14 @@ cc_outl <- function(x,
                     min_occs = 7,
                     value = "clean",
                     verbose = TRUE,
-                    intrinsic = FALSE) {
+                    intrinsic = FALSE,
+                    sampling_thresh = 0,
+                    nthreads = 1) {
+
+  match.arg(method, choices = c("quantile", "mad", "distance"))
 
   # Call the Rcpp function
-  result <- cc_outl_cpp(x[[lon]], x[[lat]], method, mltpl, tdi, min_occs, intrinsic)
+  result <- cc_outl_cpp(x, lon, lat, species, method, mltpl, tdi, min_occs, intrinsic, sampling_thresh, nthreads)
 
   if (value == "clean") {
     return(x[!result, ])
@@ -5,15 +5,16 @@
 #' @param x A data frame containing species records with geographical coordinates.
 #' @param lon The name of the longitude column in `x`. Default is "decimalLongitude".
 #' @param lat The name of the latitude column in `x`. Default is "decimalLatitude".
-#' @param ref A list of matrices representing the reference landmass polygons. If `NULL`, defaults to a predefined reference.
+#' @param ref A list of matrices representing the reference landmass polygons, or a handle from `cc_build_reference("seas", ...)`. If `NULL`, defaults to a predefined reference.
 #' @param value Character, specifying the return value: "clean" for the records within the landmass, or "flagged" for a logical vector.
 #' @param verbose Logical, indicating whether to print messages indicating progress. Default is TRUE.
 #' @param buffer Distance of the buffer in meters to apply around land areas. Default is 0.0.
+#' @param nthreads Number of threads to use; 0 uses all available cores. Default is 1.
 #'
 #' @return A data frame or logical vector depending on the `value` argument.
 #' @export
 #' @useDynLib FasterCoordinateCleaner
-cc_sea <- function(x, lon = "decimalLongitude", lat = "decimalLatitude", ref = NULL, value = "clean", verbose = TRUE, buffer = 0.0) {
+cc_sea <- function(x, lon = "decimalLongitude", lat = "decimalLatitude", ref = NULL, value = "clean", verbose = TRUE, buffer = 0.0, nthreads = 1) {
 
   if (verbose) {
     message("Testing sea coordinates")
@@ -24,11 +25,8 @@ cc_sea <- function(x, lon = "decimalLongitude", lat = "decimalLatitude", ref = N
     stop("You must provide a reference polygon for the landmass.")
   }
 
-  # Extract coordinates from data frame
-  coords <- as.matrix(x[, c(lon, lat)])
-
-  # Call the Rcpp function
-  result <- cc_sea_cpp(coords, ref, buffer)
+  # Call the Rcpp function; it reads the coordinate columns of x in place
+  result <- cc_sea_cpp(x, ref, buffer, nthreads, lon, lat)
 
   # Return results based on the value argument
   if (value == "clean") {
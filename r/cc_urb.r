@@ -3,9 +3,12 @@
 #' @param x A data.frame containing coordinates.
 #' @param lon The name of the longitude column. Default is "decimalLongitude".
 #' @param lat The name of the latitude column. Default is "decimalLatitude".
-#' @param ref A SpatVector object representing the urban areas. Default is NULL.
+#' @param ref A SpatVector object representing the urban areas, or a handle from
+#'   \code{cc_build_reference("urban", ...)}. Default is NULL.
 #' @param value The return value type, either "clean" or "flagged". Default is "clean".
 #' @param verbose Logical, whether to print messages. Default is TRUE.
+#' @param buffer Distance in meters around urban areas within which records are also treated as urban. Default is 0.
+#' @param nthreads Number of threads to use; 0 uses all available cores. Default is 1.
 #'
 #' @return A data.frame of cleaned coordinates or a logical vector of flags.
 #' @export
@@ -16,7 +19,9 @@ cc_urb <- function(x,
                    lat = "decimalLatitude",
                    ref = NULL,
                    value = "clean",
-                   verbose = TRUE) {
+                   verbose = TRUE,
+                   buffer = 0,
+                   nthreads = 1) {
 
   match.arg(value, choices = c("clean", "flagged"))
 
@@ -24,46 +29,54 @@ cc_urb <- function(x,
     message("Testing urban areas")
   }
 
-  if (is.null(ref)) {
-    message("Downloading urban areas via rnaturalearth")
-    ref <- try(suppressWarnings(terra::vect(
-      rnaturalearth::ne_download(scale = 'medium',
-                                 type = 'urban_areas',
-                                 returnclass = "sf")
-    )), silent = TRUE)
-
-    if (inherits(ref, "try-error")) {
-      warning(sprintf("Gazetteer for urban areas not found at\n%s",
-                      rnaturalearth::ne_file_name(scale = 'medium',
-                                                  type = 'urban_areas',
-                                                  full_url = TRUE)))
-      warning("Skipping urban test")
-      switch(value, clean = return(x), flagged = return(rep(NA, nrow(x))))
-    }
+  if (inherits(ref, "cc_reference")) {
+    ref_polys <- ref
   } else {
-    if (any(is(ref) == c("Spatial")) | inherits(ref, "sf")) {
-      ref <- terra::vect(ref)
-    }
-    if (!(inherits(ref, "SpatVector") & terra::geomtype(ref) == "polygons")) {
-      stop("ref must be a SpatVector with geomtype 'polygons'")
+    if (is.null(ref)) {
+      message("Downloading urban areas via rnaturalearth")
+      ref <- try(suppressWarnings(terra::vect(
+        rnaturalearth::ne_download(scale = 'medium',
+                                   type = 'urban_areas',
+                                   returnclass = "sf")
+      )), silent = TRUE)
+
+      if (inherits(ref, "try-error")) {
+        warning(sprintf("Gazetteer for urban areas not found at\n%s",
+                        rnaturalearth::ne_file_name(scale = 'medium',
+                                                    type = 'urban_areas',
+                                                    full_url = TRUE)))
+        warning("Skipping urban test")
+        switch(value, clean = return(x), flagged = return(rep(NA, nrow(x))))
+      }
+    } else {
+      if (any(is(ref) == c("Spatial")) | inherits(ref, "sf")) {
+        ref <- terra::vect(ref)
+      }
+      if (!(inherits(ref, "SpatVector") & terra::geomtype(ref) == "polygons")) {
+        stop("ref must be a SpatVector with geomtype 'polygons'")
+      }
+      ref <- reproj(ref)
     }
-    ref <- reproj(ref)
-  }
 
-  wgs84 <- "+proj=longlat +datum=WGS84 +no_defs"
+    wgs84 <- "+proj=longlat +datum=WGS84 +no_defs"
 
-  dat <- terra::vect(x[, c(lon, lat)],
-                     geom = c(lon, lat),
-                     crs = wgs84)
-  limits <- terra::ext(dat) + 1
-  ref <- terra::crop(ref, limits)
-  ref <- terra::project(ref, wgs84)
+    dat <- terra::vect(x[, c(lon, lat)],
+                       geom = c(lon, lat),
+                       crs = wgs84)
+    limits <- terra::ext(dat) + 1
+    ref <- terra::crop(ref, limits)
+    ref <- terra::project(ref, wgs84)
 
-  ref_coords <- as.matrix(terra::geom(ref)[, c("x", "y")])
-  lon_col <- x[[lon]]
-  lat_col <- x[[lat]]
+    # One entry per polygon part: a list of rings (the exterior and its holes)
+    # as lon/lat matrices, so points in a hole are outside
+    geom <- terra::geom(ref)
+    parts <- split(seq_len(nrow(geom)), paste(geom[, "geom"], geom[, "part"]))
+    ref_polys <- unname(lapply(parts, function(p) {
+      unname(lapply(split(p, geom[p, "hole"]), function(h) geom[h, c("x", "y"), drop = FALSE]))
+    }))
+  }
 
-  result <- cc_urb_cpp(lon_col, lat_col, ref_coords)
+  result <- cc_urb_cpp(x, ref_polys, buffer, nthreads, lon, lat)
 
   if (verbose) {
     if (value == "clean") {
@@ -11,6 +11,7 @@
 #' @param lat The name of the latitude column. Default is "decimalLatitude".
 #' @param value The return value type, either "clean" or "flagged". Default is "clean".
 #' @param verbose Logical, whether to print messages. Default is TRUE.
+#' @param nthreads Number of threads to use; 0 uses all available cores. Default is 1.
 #'
 #' @return A data.frame of cleaned coordinates or a logical vector of flags.
 #' @export
@@ -20,7 +21,8 @@ cc_val <- function(x,
                    lon = "decimalLongitude",
                    lat = "decimalLatitude",
                    value = "clean",
-                   verbose = TRUE) {
+                   verbose = TRUE,
+                   nthreads = 1) {
 
   match.arg(value, choices = c("clean", "flagged"))
 
@@ -34,7 +36,7 @@ cc_val <- function(x,
   lon_col <- x[[lon]]
   lat_col <- x[[lat]]
 
-  result <- cc_val_cpp(lon_col, lat_col)
+  result <- cc_val_cpp(lon_col, lat_col, nthreads)
 
   if (verbose) {
     if (value == "clean") {
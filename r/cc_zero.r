@@ -6,6 +6,7 @@
 #' @param buffer The buffer distance around the 0/0 point, in decimal degrees. Default is 0.5.
 #' @param value The return value type, either "clean" or "flagged". Default is "clean".
 #' @param verbose Logical, whether to print messages. Default is TRUE.
+#' @param nthreads Number of threads to use; 0 uses all available cores. Default is 1.
 #'
 #' @return A data.frame of cleaned coordinates or a logical vector of flags.
 #' @export
@@ -16,7 +17,8 @@ cc_zero <- function(x,
                     lat = "decimalLatitude",
                     buffer = 0.5,
                     value = "clean",
-                    verbose = TRUE) {
+                    verbose = TRUE,
+                    nthreads = 1) {
 
   match.arg(value, choices = c("clean", "flagged"))
 
@@ -31,7 +33,7 @@ cc_zero <- function(x,
   lon_col <- x[[lon]]
   lat_col <- x[[lat]]
 
-  result <- cc_zero_cpp(lon_col, lat_col, buffer)
+  result <- cc_zero_cpp(lon_col, lat_col, buffer, nthreads)
 
   if (verbose) {
     if (value == "clean") {
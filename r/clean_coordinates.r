@@ -12,28 +12,63 @@
 #' @param countries_col (Optional) Name of the column with country codes. Set to `NULL` if not applicable.
 #' @param capitals_rad Radius (in meters) around capitals for proximity checks. Default is `10000`.
 #' @param centroids_rad Radius (in meters) around centroids for proximity checks. Default is `1000`.
-#' @param centroids_detail String specifying details for the centroids test. Default is `"both"`.
+#' @param centroids_detail Which centroids the centroids test uses: `"country"`, `"provinces"` or `"both"`. Default is `"both"`.
 #' @param inst_rad Radius (in meters) for institution proximity checks. Default is `100`.
 #' @param outliers_method Method for detecting outliers. Default is `"quantile"`.
 #' @param outliers_mtp Multiplier for the outliers method. Default is `5`.
 #' @param outliers_td Threshold distance for the outliers method. Default is `1000`.
 #' @param outliers_size Minimum occurrence count for outlier detection. Default is `7`.
-#' @param range_rad Radius for the range check. Default is `0`.
+#' @param range_rad Buffer in meters around species ranges for the range check, approximate as for the
+#'   `buffer` of `cc_iucn()`. Default is `0`.
 #' @param zeros_rad Radius for zero-coordinate proximity checks. Default is `0.5`.
-#' @param capitals_ref Reference data for capitals. Set to `NULL` if not applicable.
-#' @param centroids_ref Reference data for centroids. Set to `NULL` if not applicable.
-#' @param country_ref Reference data for countries. Set to `NULL` if not applicable.
-#' @param country_refcol Column in `country_ref` used to match countries. Default is `"iso_a3"`.
-#' @param country_buffer (Optional) Numeric vector for country buffer distances.
-#' @param inst_ref Reference data for institutions. Set to `NULL` if not applicable.
-#' @param range_ref Reference data for range check. Set to `NULL` if not applicable.
-#' @param seas_ref Reference data for seas. Set to `NULL` if not applicable.
-#' @param seas_scale Scaling factor for sea proximity checks. Default is `50`.
-#' @param seas_buffer (Optional) Numeric vector for sea buffer distances.
-#' @param urban_ref Reference data for urban areas. Set to `NULL` if not applicable.
+#' @param capitals_ref Reference data for capitals. May also be a handle from `cc_build_reference("capitals", ...)`.
+#'   Set to `NULL` if not applicable.
+#' @param centroids_ref Reference data for centroids. May also be a handle from `cc_build_reference("centroids", ...)`.
+#'   Set to `NULL` if not applicable.
+#' @param country_ref Reference data for countries: country polygons as a SpatVector or sf object, a list of
+#'   countries with their `iso3` codes and polygons (see `cc_build_reference()`), or a handle from
+#'   `cc_build_reference("countries", ...)`. Records outside the polygons of the country in `countries_col`
+#'   are flagged. Set to `NULL` if not applicable.
+#' @param country_refcol Column of a spatial `country_ref` holding the ISO3 codes. Default is `"iso_a3"`.
+#'   Not used for a list or a handle, which carry the codes in their `iso3` entries.
+#' @param country_buffer (Optional) Buffer in meters around the declared country; records this close to its
+#'   border are not flagged.
+#' @param inst_ref Reference data for institutions. May also be a handle from `cc_build_reference("institutions", ...)`.
+#'   Set to `NULL` if not applicable.
+#' @param range_ref Reference data for range check. May also be a handle from `cc_build_reference("range", ...)`.
+#'   Set to `NULL` if not applicable.
+#' @param seas_ref Reference data for seas. May also be a handle from `cc_build_reference("seas", ...)`.
+#'   Set to `NULL` if not applicable.
+#' @param seas_scale Scale of the Natural Earth land reference. Not used by the native sea test. Default is `50`.
+#' @param seas_buffer (Optional) Buffer in meters around land; records this close to the coast are not flagged.
+#' @param urban_ref Reference data for urban areas. May also be a handle from `cc_build_reference("urban", ...)`.
+#'   Set to `NULL` if not applicable.
 #' @param aohi_rad Radius for areas of high interest. Default is `1000`.
 #' @return A list with `results`, a logical matrix for each test per row, and `summary`, a logical vector indicating rows that passed all tests.
+#'   With `output = "packed"`, `results` holds the flags packed one bit per test and row (see `cc_flags_test()`),
+#'   and `clean` the row numbers of the records that passed all tests, in place of `summary`.
+#'   With `plan = TRUE` it also holds `plan`, a data.frame of the tests in the order they ran with the
+#'   estimated `cost_per_record` (seconds) and `pass_rate`, the `expected_records` each test would see, and the
+#'   `records` and `seconds` it actually took.
 #' @param verbose Logical, if `TRUE`, outputs additional information during processing.
+#' @param nthreads Number of threads to use; 0 uses all available cores. Default is 1.
+#' @param fused Logical. If `TRUE`, the per-record tests ("equal", "zeros", "capitals", "seas", "urban",
+#'   "gbif", "countries", and "range" with bounding-box ranges) and the coordinate validation run together
+#'   in a single pass over blocks of records; if `FALSE`, each runs as its own pass. Results are the same
+#'   either way. Default is `TRUE`.
+#' @param short_circuit Logical. If `TRUE`, tests run cheapest first and each test only sees the records
+#'   that passed all earlier ones; cells of records a test skipped are `NA` in `results`. The `summary` is
+#'   unchanged, but "duplicates" and "outliers" are then computed among the remaining records only.
+#'   `fused` has no effect in this mode. Default is `FALSE`.
+#' @param plan Logical. If `TRUE`, each per-record test is first timed on a sample of 1000 records to
+#'   estimate its cost per record and pass rate, and the tests then run short-circuited (see
+#'   `short_circuit`) in the order that minimises the expected total time. "duplicates", "outliers",
+#'   "institutions", "centroids" and "range" with polygon ranges depend on the other records of a species
+#'   or of the data set, so they are not sampled: they run last, in the order requested, and their
+#'   estimates in `plan` are `NA`. Default is `FALSE`.
+#' @param output `"logical"` returns the flags as a logical matrix; `"packed"` keeps them packed, one bit per
+#'   test and row, which takes 32 times less memory, and returns the clean rows as row numbers rather than a
+#'   logical vector. Default is `"logical"`.
 #' @export
 #' @examples
 #' # Load example data and reference data if needed
@@ -72,11 +107,32 @@ clean_coordinates <- function(x,
                               seas_buffer = NULL,
                               urban_ref = NULL,
                               aohi_rad = 1000,
-                              verbose = TRUE) {
+                              verbose = TRUE,
+                              nthreads = 1,
+                              fused = TRUE,
+                              short_circuit = FALSE,
+                              plan = FALSE,
+                              output = "logical") {
   # Ensure optional reference data is set to R_NilValue if not provided
   if (is.null(capitals_ref)) capitals_ref <- R_NilValue
   if (is.null(centroids_ref)) centroids_ref <- R_NilValue
   if (is.null(country_ref)) country_ref <- R_NilValue
+  if (any(is(country_ref) == "Spatial") | inherits(country_ref, "sf")) {
+    country_ref <- terra::vect(country_ref)
+  }
+  if (inherits(country_ref, "SpatVector")) {
+    # One entry per country feature: its ISO3 code and its polygons, each a
+    # list of rings (the exterior and its holes) as lon/lat matrices
+    geom <- terra::geom(country_ref)
+    ref_iso3 <- as.character(country_ref[[country_refcol]][, 1])
+    country_ref <- lapply(split(seq_len(nrow(geom)), geom[, "geom"]), function(f) {
+      polygons <- lapply(split(f, geom[f, "part"]), function(p) {
+        unname(lapply(split(p, geom[p, "hole"]), function(h) geom[h, c("x", "y"), drop = FALSE]))
+      })
+      list(iso3 = ref_iso3[geom[f[1], "geom"]], polygons = unname(polygons))
+    })
+    country_ref <- unname(country_ref)
+  }
   if (is.null(country_buffer)) country_buffer <- R_NilValue
   if (is.null(inst_ref)) inst_ref <- R_NilValue
   if (is.null(range_ref)) range_ref <- R_NilValue
@@ -89,7 +145,7 @@ clean_coordinates <- function(x,
                         capitals_rad, centroids_rad, centroids_detail, inst_rad,
                         outliers_method, outliers_mtp, outliers_td, outliers_size,
                         range_rad, zeros_rad, capitals_ref, centroids_ref,
-                        country_ref, country_refcol, country_buffer, inst_ref,
-                        range_ref, seas_ref, seas_scale, seas_buffer, urban_ref,
-                        aohi_rad, verbose)
+                        country_ref, country_buffer, inst_ref, range_ref,
+                        seas_ref, seas_scale, seas_buffer, urban_ref,
+                        aohi_rad, verbose, nthreads, fused, short_circuit, plan, output)
 }
@@ -0,0 +1,72 @@
+#' Clean Geographic Coordinates in a File
+#' @name clean_coordinates_file
+#' @title Clean an occurrence file too large to load
+#' @description Runs the cleaning tests over a tab-delimited occurrence file, such as the `occurrence.txt` of a
+#'   GBIF download, without reading it into R. The file is read in windows of `chunk_mb` megabytes and only the
+#'   coordinate, species and country columns are parsed. Per-record tests run on each window as it is read;
+#'   "outliers", "duplicates" and "range" run afterwards on species groups spilled to `tmp_dir`. Records with
+#'   missing or impossible coordinates fail the "validity" column rather than stopping the run.
+#'
+#' @param input Path of the occurrence file. Its first line must name the columns.
+#' @param output Path of the file to write.
+#' @param tests A character vector of tests: "equal", "zeros", "capitals", "seas", "urban", "countries", "gbif",
+#'   "outliers", "duplicates" and "range". "centroids" and "institutions" need the records in memory; use
+#'   `clean_coordinates()` for them.
+#' @param lon_col Name of the longitude column. Defaults to `"decimalLongitude"`.
+#' @param lat_col Name of the latitude column. Defaults to `"decimalLatitude"`.
+#' @param species_col Name of the species column. Defaults to `"species"`.
+#' @param countries_col Name of the column with country codes. Defaults to `"countryCode"`.
+#' @param value `"flagged"` writes one tab-separated line of flags per record, with a final summary column;
+#'   `"clean"` writes the header and the lines of the records that passed every test. Default is `"flagged"`.
+#' @param capitals_rad,outliers_method,outliers_mtp,outliers_td,outliers_size,range_rad,zeros_rad As for
+#'   `clean_coordinates()`.
+#' @param capitals_ref,country_ref,range_ref,seas_ref,urban_ref Reference data as for `clean_coordinates()`, or
+#'   handles from `cc_build_reference()`.
+#' @param country_buffer Buffer in meters around country polygons. Default is `0`.
+#' @param seas_buffer Buffer in meters around land polygons. Default is `0`.
+#' @param chunk_mb Size of the windows read, in megabytes, and the memory budget of a species bucket in the
+#'   species-level tests. Buckets over it are split again; a single species is always tested whole, so peak
+#'   memory is about `chunk_mb`, or the records of the largest species if that is more. Default is `64`.
+#' @param tmp_dir Directory for the spilled species groups. Default is `tempdir()`.
+#' @param verbose Logical; if `TRUE`, reports progress. Default is `TRUE`.
+#' @param nthreads Number of threads to use; 0 uses all available cores. Default is `1`.
+#'
+#' @return A list with the `output` path, the number of `records` read, and the number of records `flagged` by
+#'   each test and in the summary.
+#' @export
+clean_coordinates_file <- function(input,
+                                   output,
+                                   tests,
+                                   lon_col = "decimalLongitude",
+                                   lat_col = "decimalLatitude",
+                                   species_col = "species",
+                                   countries_col = "countryCode",
+                                   value = "flagged",
+                                   capitals_rad = 10000.0,
+                                   outliers_method = "quantile",
+                                   outliers_mtp = 5,
+                                   outliers_td = 1000,
+                                   outliers_size = 7,
+                                   range_rad = 0,
+                                   zeros_rad = 0.5,
+                                   capitals_ref = NULL,
+                                   country_ref = NULL,
+                                   country_buffer = 0,
+                                   range_ref = NULL,
+                                   seas_ref = NULL,
+                                   seas_buffer = 0,
+                                   urban_ref = NULL,
+                                   chunk_mb = 64,
+                                   tmp_dir = tempdir(),
+                                   verbose = TRUE,
+                                   nthreads = 1) {
+  if (!file.exists(input)) {
+    stop("Input file not found: ", input)
+  }
+
+  cc_stream_cpp(path.expand(input), path.expand(output), tests, lon_col, lat_col, species_col,
+                countries_col, value, capitals_rad, outliers_method, outliers_mtp, outliers_td,
+                outliers_size, range_rad, zeros_rad, capitals_ref, country_ref, country_buffer,
+                range_ref, seas_ref, seas_buffer, urban_ref, chunk_mb, path.expand(tmp_dir),
+                verbose, nthreads)
+}
@@ -1,71 +1,117 @@
 #include <Rcpp.h>
+#include <algorithm>
 #include <cmath>
 
+#include "cc_coords.h"
+#include "cc_dist.h"
+#include "cc_index.h"
+#include "cc_parallel.h"
+#include "cc_reference.h"
+
 using namespace Rcpp;
 
 // [[Rcpp::plugins("cpp11")]]
 
-const double EARTH_RADIUS = 6371000.0;  // Earth radius in meters
-const double DEG_TO_RAD = 3.14159265358979323846 / 180.0;  // Precomputed for faster radian conversion
-
-// Convert degrees to radians
-inline double deg2rad(double deg) {
-  return deg * DEG_TO_RAD;
+// Half-width in degrees of longitude that can hold a planar match: the
+// longitude difference is scaled by cos of the mean latitude, which is
+// smallest at the edge of the latitude band the match must lie in
+inline double planar_lon_window(double lat, double half_lat) {
+  double edge = std::max(std::abs(lat - half_lat / 2.0), std::abs(lat + half_lat / 2.0));
+  if (!(edge < 89.9)) {
+    return R_PosInf;
+  }
+  return half_lat / cos(edge * DEG_TO_RAD);
 }
 
-// Calculate geodesic distance between two points
-inline double geodesic_distance(double lon1, double lat1, double lon2, double lat2) {
-  double phi1 = deg2rad(lat1);
-  double phi2 = deg2rad(lat2);
-  double delta_phi = phi2 - phi1;
-  double delta_lambda = deg2rad(lon2 - lon1);
+// The two metrics of the test, as compile-time policies: near() tells whether
+// any reference point in index lies within the buffer of lon/lat
+struct CapGeodesic {
+  explicit CapGeodesic(double buffer) : limit(buffer) {}
+
+  bool near(const PointIndex& index, double lon, double lat) const {
+    return index.any_within(lon, lat, limit);
+  }
+
+  bool near(const PointIndex& index, const UnitVector& u, double lon, double lat) const {
+    return index.any_within(u, lon, lat, limit);
+  }
+
+  ChordLimit limit;
+};
+
+struct CapPlanar {
+  explicit CapPlanar(double buffer) : half_lat(buffer / METERS_PER_DEGREE), limit(buffer, METERS_PER_DEGREE) {}
 
-  double a = sin(delta_phi / 2.0) * sin(delta_phi / 2.0) +
-    cos(phi1) * cos(phi2) * sin(delta_lambda / 2.0) * sin(delta_lambda / 2.0);
-  return 2.0 * EARTH_RADIUS * atan2(sqrt(a), sqrt(1.0 - a));
+  bool near(const PointIndex& index, double lon, double lat) const {
+    return index.any_in_box(lon, lat, planar_lon_window(lat, half_lat), half_lat, [&](int j) {
+      // Planar distance: the longitude offset is scaled by cos of the mean latitude
+      double y = index.lat(j) - lat;
+      if (limit.beyond(y)) return false;
+      double x = (index.lon(j) - lon) * cos((lat + index.lat(j)) * DEG_TO_RAD / 2.0);
+      return limit.within(x * x + y * y);
+    });
+  }
+
+  double half_lat;
+  PlanarLimit limit;
+};
+
+template <class Metric>
+static void cap_block(const double* lon, const double* lat, const Metric& metric, const PointIndex& index,
+                      R_xlen_t begin, R_xlen_t end, int* out) {
+  // Candidates come from the index; the distance test itself is unchanged
+  for (R_xlen_t i = begin; i < end; i++) {
+    out[i] = !metric.near(index, lon[i], lat[i]);
+  }
 }
 
-// Calculate planar distance between two points
-inline double planar_distance(double lon1, double lat1, double lon2, double lat2) {
-  double x = (lon2 - lon1) * cos((lat1 + lat2) * DEG_TO_RAD / 2.0);
-  double y = lat2 - lat1;
-  return 111319.9 * sqrt(x * x + y * y);  // Convert degrees to meters
+// Flags records [begin, end) within buffer of any reference point held in
+// index. Geodesic runs take the records' unit vectors from geo when given.
+void cc_cap_block(const double* lon, const double* lat, double buffer, bool geod,
+                  const PointIndex& index, R_xlen_t begin, R_xlen_t end, int* out,
+                  const RecordGeometry* geo = NULL) {
+  if (geod && geo) {
+    CapGeodesic metric(buffer);
+    for (R_xlen_t i = begin; i < end; i++) {
+      out[i] = !metric.near(index, geo->unit(i), lon[i], lat[i]);
+    }
+  } else if (geod) {
+    cap_block(lon, lat, CapGeodesic(buffer), index, begin, end, out);
+  } else {
+    cap_block(lon, lat, CapPlanar(buffer), index, begin, end, out);
+  }
 }
 
 //' @title Check coordinates against capital cities
- //' @param points NumericMatrix with longitude and latitude columns
+ //' @param points data.frame or matrix with longitude and latitude columns, read in place
  //' @param buffer numeric buffer distance in meters
  //' @param geod logical indicating whether to use geodesic distance
- //' @param ref_coords NumericMatrix with reference coordinates
+ //' @param ref_coords NumericMatrix with reference coordinates, or a handle from cc_build_reference()
+ //' @param nthreads number of threads; 0 uses all cores
+ //' @param lon_col,lat_col coordinate columns when points is a data.frame
  //' @return LogicalVector indicating which records are valid (not within buffer of capitals)
  // [[Rcpp::export]]
- LogicalVector cc_cap_cpp(NumericMatrix points,
+ LogicalVector cc_cap_cpp(SEXP points,
                           double buffer,
                           bool geod,
-                          NumericMatrix ref_coords) {
-
-   int n_points = points.nrow();
-   int n_refs = ref_coords.nrow();
-   LogicalVector result(n_points, true);
-
-   for (int i = 0; i < n_points; i++) {
-     double point_lon = points(i, 0);
-     double point_lat = points(i, 1);
-
-     for (int j = 0; j < n_refs; j++) {
-       double ref_lon = ref_coords(j, 0);
-       double ref_lat = ref_coords(j, 1);
-
-       // Choose distance function based on 'geod'
-       double dist = geod ? geodesic_distance(point_lon, point_lat, ref_lon, ref_lat)
-         : planar_distance(point_lon, point_lat, ref_lon, ref_lat);
-
-       if (dist <= buffer) {
-         result[i] = false;
-         break;  // Early exit if within buffer
-       }
-     }
-   }
+                          SEXP ref_coords,
+                          int nthreads = 1,
+                          std::string lon_col = "decimalLongitude",
+                          std::string lat_col = "decimalLatitude") {
+
+   std::unique_ptr<Reference> owned;
+   const PointReference& ref = get_reference<PointReference>(ref_coords, "capitals", owned);
+
+   CoordView coords(points, lon_col, lat_col);
+   R_xlen_t n_points = coords.size();
+   LogicalVector result(n_points);
+   const double* lon = coords.lon();
+   const double* lat = coords.lat();
+   int* out = result.begin();
+
+   cc_parallel_for(n_points, nthreads, [&](R_xlen_t begin, R_xlen_t end) {
+     cc_cap_block(lon, lat, buffer, geod, ref.index, begin, end, out);
+   });
 
    return result;
  }
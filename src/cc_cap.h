@@ -2,8 +2,17 @@
 #define CC_CAP_H
 
 #include <Rcpp.h>
+#include "cc_coords.h"
+#include "cc_index.h"
 using namespace Rcpp;
 
-LogicalVector cc_cap_cpp(NumericMatrix points, double buffer, bool geod, NumericMatrix ref_coords);
+LogicalVector cc_cap_cpp(SEXP points, double buffer, bool geod, SEXP ref_coords, int nthreads = 1,
+                         std::string lon_col = "decimalLongitude", std::string lat_col = "decimalLatitude");
+
+// Writes the flags of records [begin, end) to out; geo, if given, holds the
+// records' geometry indexed like lon and lat
+void cc_cap_block(const double* lon, const double* lat, double buffer, bool geod,
+                  const PointIndex& index, R_xlen_t begin, R_xlen_t end, int* out,
+                  const RecordGeometry* geo = NULL);
 
 #endif  // CC_CAP_H
@@ -1,18 +1,138 @@
 #include <Rcpp.h>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <utility>
+
+#include "cc_coords.h"
+#include "cc_dist.h"
+#include "cc_flags.h"
+#include "cc_parallel.h"
+#include "cc_reference.h"
 using namespace Rcpp;
 
+// The two metrics of the test, as compile-time policies: near() tells whether
+// any centroid in index lies within the buffer of lon/lat
+struct CenGeodesic {
+  explicit CenGeodesic(double buffer) : limit(buffer) {}  // meters
+
+  bool near(const PointIndex& index, double lon, double lat) const {
+    return index.any_within(lon, lat, limit);
+  }
+
+  bool near(const PointIndex& index, const UnitVector& u, double lon, double lat) const {
+    return index.any_within(u, lon, lat, limit);
+  }
+
+  ChordLimit limit;
+};
+
+struct CenPlanar {
+  explicit CenPlanar(double buffer) : radius(buffer), limit(buffer, 1.0) {}  // degrees
+
+  bool near(const PointIndex& index, double lon, double lat) const {
+    return index.any_in_box(lon, lat, radius, radius, [&](int j) {
+      double d_lat = lat - index.lat(j);
+      if (limit.beyond(d_lat)) return false;
+      double d_lon = lon - index.lon(j);
+      return limit.within(d_lon * d_lon + d_lat * d_lat);
+    });
+  }
+
+  double radius;
+  PlanarLimit limit;
+};
+
+template <class Metric>
+static void flag_near(const double* px, const double* py, int n, const Metric& metric, const PointIndex& index,
+                      int nthreads, int* flags) {
+  cc_parallel_for(n, nthreads, [&](R_xlen_t begin, R_xlen_t end) {
+    for (R_xlen_t i = begin; i < end; i++) {
+      flags[i] = !metric.near(index, px[i], py[i]);
+    }
+  });
+}
+
+// Bits of a coordinate as compared by ==, so 0 and -0 are the same
+inline uint64_t coordinate_bits(double x) {
+  if (x == 0) x = 0;
+  uint64_t bits;
+  std::memcpy(&bits, &x, sizeof(bits));
+  return bits;
+}
+
+struct CoordinateHash {
+  size_t operator()(const std::pair<uint64_t, uint64_t>& key) const {
+    uint64_t h = key.first * 0x9e3779b97f4a7c15ULL ^ key.second;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return (size_t) h;
+  }
+};
+
+// Clears the flag of every flagged record whose coordinates occur more than
+// once in the data. Only the coordinates of flagged records are counted, in
+// one pass over all records; missing coordinates never equal anything.
+static void unflag_repeated(const double* px, const double* py, int n, int* flags) {
+  typedef std::pair<uint64_t, uint64_t> Key;
+  std::unordered_map<Key, int, CoordinateHash> counts;
+  for (int i = 0; i < n; i++) {
+    if (!flags[i] && !ISNAN(px[i]) && !ISNAN(py[i])) {
+      counts.insert(std::make_pair(Key(coordinate_bits(px[i]), coordinate_bits(py[i])), 0));
+    }
+  }
+  if (counts.empty()) return;
+
+  for (int j = 0; j < n; j++) {
+    auto found = counts.find(Key(coordinate_bits(px[j]), coordinate_bits(py[j])));
+    if (found != counts.end()) found->second++;
+  }
+  for (int i = 0; i < n; i++) {
+    if (!flags[i] && !ISNAN(px[i]) && !ISNAN(py[i]) &&
+        counts[Key(coordinate_bits(px[i]), coordinate_bits(py[i]))] > 1) {
+      flags[i] = true;
+    }
+  }
+}
+
+// Flags (FALSE) the n records within buffer of a centroid held in index:
+// great-circle meters with geod, plain Euclidean degrees otherwise. With
+// verify, records sharing their coordinates with another record are kept.
+// Geodesic runs take the records' unit vectors from geo when given.
+void cc_cen_flags(const double* px, const double* py, int n, const PointIndex& index, double buffer,
+                  bool geod, bool verify, int nthreads, int* flags, const RecordGeometry* geo = NULL) {
+  if (geod && geo) {
+    CenGeodesic metric(buffer);
+    cc_parallel_for(n, nthreads, [&](R_xlen_t begin, R_xlen_t end) {
+      for (R_xlen_t i = begin; i < end; i++) {
+        flags[i] = !metric.near(index, geo->unit(i), px[i], py[i]);
+      }
+    });
+  } else if (geod) {
+    flag_near(px, py, n, CenGeodesic(buffer), index, nthreads, flags);
+  } else {
+    flag_near(px, py, n, CenPlanar(buffer), index, nthreads, flags);
+  }
+
+  if (verify) {
+    unflag_repeated(px, py, n, flags);
+  }
+}
+
 // [[Rcpp::export]]
-LogicalVector cc_cen_cpp(DataFrame x,
-                         std::string lon,
-                         std::string lat,
-                         std::string species,
-                         double buffer,
-                         bool geod,
-                         std::string test,
-                         DataFrame ref,   // Remove the default argument here
-                         bool verify,
-                         std::string value,
-                         bool verbose) {
+SEXP cc_cen_cpp(DataFrame x,
+                std::string lon,
+                std::string lat,
+                std::string species,
+                double buffer,
+                bool geod,
+                std::string test,
+                SEXP ref,   // data.frame or cc_build_reference() handle
+                bool verify,
+                std::string value,
+                bool verbose,
+                int nthreads = 1) {
 
   int n = x.nrows();
   LogicalVector out(n, true);
@@ -36,56 +156,20 @@ LogicalVector cc_cen_cpp(DataFrame x,
     warning("Using small buffer, check 'geod'");
   }
 
-  // Extract coordinates from x
-  NumericVector x_lon = x[lon];
-  NumericVector x_lat = x[lat];
-
-  // Extract coordinates from ref
-  NumericVector ref_lon = ref["centroid.lon"];
-  NumericVector ref_lat = ref["centroid.lat"];
+  // Coordinates of x, read in place
+  CoordView coords(x, lon, lat);
 
-  // Calculate distances and flag problematic records
-  for (int i = 0; i < n; ++i) {
-    for (int j = 0; j < ref.nrows(); ++j) {
-      double d_lon = x_lon[i] - ref_lon[j];
-      double d_lat = x_lat[i] - ref_lat[j];
+  // Index the reference centroids of the kind tested
+  std::unique_ptr<Reference> owned;
+  const PointIndex& index = get_reference<CentroidReference>(ref, "centroids", owned).select(test);
 
-      // Simple Euclidean distance, needs adjustment for spherical calculations
-      double distance = sqrt(d_lon * d_lon + d_lat * d_lat);
-
-      if (geod) {
-        // Convert degrees to meters (approximate)
-        distance *= 111320.0;
-      }
-
-      if (distance <= buffer) {
-        out[i] = false;
-        break;
-      }
-    }
-  }
-
-  // Verification step
-  if (verify) {
-    NumericVector flag_count(n, 0.0);
-    for (int i = 0; i < n; ++i) {
-      if (!out[i]) {
-        for (int j = 0; j < n; ++j) {
-          if (x_lon[i] == x_lon[j] && x_lat[i] == x_lat[j]) {
-            flag_count[i]++;
-          }
-        }
-        if (flag_count[i] > 1) {
-          out[i] = true;
-        }
-      }
-    }
-  }
+  // Flag records within buffer of a centroid, then verify
+  int* flags = out.begin();
+  cc_cen_flags(coords.lon(), coords.lat(), n, index, buffer, geod, verify, nthreads, flags);
 
-  // Return results
+  // Return the rows of the clean records, or the flags
   if (value == "clean") {
-    DataFrame result = x[out];
-    return wrap(result);
+    return flag_rows(flags, n);
   } else {
     return out;
   }
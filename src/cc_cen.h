@@ -2,10 +2,17 @@
 #define CC_CEN_H
 
 #include <Rcpp.h>
+#include "cc_coords.h"
+#include "cc_index.h"
 using namespace Rcpp;
 
-LogicalVector cc_cen_cpp(DataFrame x, std::string lon, std::string lat, std::string species,
-                         double buffer, bool geod, std::string test, DataFrame ref,
-                         bool verify, std::string value, bool verbose);
+SEXP cc_cen_cpp(DataFrame x, std::string lon, std::string lat, std::string species,
+                double buffer, bool geod, std::string test, SEXP ref,
+                bool verify, std::string value, bool verbose, int nthreads = 1);
+
+// Writes the flags of the n records to flags; geo, if given, holds the
+// records' geometry indexed like px and py
+void cc_cen_flags(const double* px, const double* py, int n, const PointIndex& index, double buffer,
+                  bool geod, bool verify, int nthreads, int* flags, const RecordGeometry* geo = NULL);
 
 #endif  // CC_CEN_H
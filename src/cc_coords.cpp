@@ -0,0 +1,83 @@
+#include <Rcpp.h>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "cc_coords.h"
+#include "cc_parallel.h"
+using namespace Rcpp;
+
+// x as doubles: itself if it already is, else a converted copy
+static SEXP as_real(SEXP x) {
+  switch (TYPEOF(x)) {
+    case REALSXP: return x;
+    case INTSXP:
+    case LGLSXP: return Rf_coerceVector(x, REALSXP);
+    default: stop("Coordinates must be numeric");
+  }
+}
+
+CoordView::CoordView(SEXP x, const std::string& lon_col, const std::string& lat_col)
+  : lon_(NULL), lat_(NULL), n_(0) {
+  if (Rf_isFrame(x)) {
+    DataFrame df(x);
+    if (!df.containsElementNamed(lon_col.c_str()) || !df.containsElementNamed(lat_col.c_str())) {
+      stop("Longitude and latitude columns '" + lon_col + "' and '" + lat_col + "' not found");
+    }
+    set_columns(df[lon_col], df[lat_col]);
+  } else if (Rf_isMatrix(x)) {
+    if (Rf_ncols(x) < 2) stop("Coordinate matrix must have longitude and latitude columns");
+    lon_data_ = as_real(x);
+    lat_data_ = lon_data_;
+    n_ = Rf_nrows(x);
+    lon_ = REAL(lon_data_);
+    lat_ = lon_ + n_;
+  } else {
+    stop("Coordinates must be a data.frame or a matrix");
+  }
+}
+
+CoordView::CoordView(SEXP lon, SEXP lat) : lon_(NULL), lat_(NULL), n_(0) {
+  set_columns(lon, lat);
+}
+
+void CoordView::set_columns(SEXP lon, SEXP lat) {
+  if (Rf_xlength(lon) != Rf_xlength(lat)) {
+    stop("Longitude and latitude must have the same length");
+  }
+  lon_data_ = as_real(lon);
+  lat_data_ = as_real(lat);
+  n_ = Rf_xlength(lon);
+  lon_ = REAL(lon_data_);
+  lat_ = REAL(lat_data_);
+}
+
+GeoCache::GeoCache(const double* lon, const double* lat, R_xlen_t n, int nthreads)
+  : ux_(n), uy_(n), uz_(n), cos_lat_(n) {
+  double* ux = ux_.data();
+  double* uy = uy_.data();
+  double* uz = uz_.data();
+  double* cos_lat = cos_lat_.data();
+  // The arithmetic of unit_vector(), keeping cos of the latitude on the way
+  cc_parallel_for(n, nthreads, [&](R_xlen_t begin, R_xlen_t end) {
+    for (R_xlen_t i = begin; i < end; i++) {
+      double phi = lat[i] * DEG_TO_RAD;
+      double lambda = lon[i] * DEG_TO_RAD;
+      double c = cos(phi);
+      cos_lat[i] = c;
+      ux[i] = c * cos(lambda);
+      uy[i] = c * sin(lambda);
+      uz[i] = sin(phi);
+    }
+  });
+}
+
+GeoCache::GeoCache(const GeoCache& from, const std::vector<int>& rows)
+  : ux_(rows.size()), uy_(rows.size()), uz_(rows.size()), cos_lat_(rows.size()) {
+  for (size_t k = 0; k < rows.size(); k++) {
+    ux_[k] = from.ux_[rows[k]];
+    uy_[k] = from.uy_[rows[k]];
+    uz_[k] = from.uz_[rows[k]];
+    cos_lat_[k] = from.cos_lat_[rows[k]];
+  }
+}
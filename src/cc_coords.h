@@ -0,0 +1,76 @@
+#ifndef CC_COORDS_H
+#define CC_COORDS_H
+
+#include <Rcpp.h>
+#include <string>
+#include <vector>
+
+#include "cc_dist.h"
+using namespace Rcpp;
+
+// Longitudes and latitudes of the records, read in place from the R objects
+// that hold them: two columns of a data.frame, the first two columns of a
+// matrix, or two vectors. Double data is never copied; integer data is
+// converted once. The view keeps its R objects alive.
+class CoordView {
+public:
+  CoordView() : lon_(NULL), lat_(NULL), n_(0) {}
+  CoordView(SEXP x, const std::string& lon_col, const std::string& lat_col);
+  CoordView(SEXP lon, SEXP lat);
+
+  R_xlen_t size() const { return n_; }
+  const double* lon() const { return lon_; }
+  const double* lat() const { return lat_; }
+
+private:
+  RObject lon_data_, lat_data_;
+  const double* lon_;
+  const double* lat_;
+  R_xlen_t n_;
+
+  void set_columns(SEXP lon, SEXP lat);
+};
+
+// Geometry of the records that the distance tests would otherwise each work
+// out again, one array per quantity, indexed like the coordinates: the unit
+// vector on the sphere (uz is sin of the latitude) and cos of the latitude.
+// Values equal unit_vector() and cos(lat * DEG_TO_RAD) bit for bit, so flags
+// do not depend on whether a kernel is handed them.
+struct RecordGeometry {
+  const double* ux;
+  const double* uy;
+  const double* uz;
+  const double* cos_lat;
+
+  UnitVector unit(R_xlen_t i) const {
+    UnitVector u = {ux[i], uy[i], uz[i]};
+    return u;
+  }
+
+  // The geometry from record offset on
+  RecordGeometry from(R_xlen_t offset) const {
+    RecordGeometry shifted = {ux + offset, uy + offset, uz + offset, cos_lat + offset};
+    return shifted;
+  }
+};
+
+// Owns the RecordGeometry arrays of one run, filled once in parallel chunks
+class GeoCache {
+public:
+  GeoCache() {}
+  GeoCache(const double* lon, const double* lat, R_xlen_t n, int nthreads = 1);
+
+  // The given rows of from, in order
+  GeoCache(const GeoCache& from, const std::vector<int>& rows);
+
+  bool empty() const { return ux_.empty(); }
+  RecordGeometry view() const {
+    RecordGeometry geo = {ux_.data(), uy_.data(), uz_.data(), cos_lat_.data()};
+    return geo;
+  }
+
+private:
+  std::vector<double> ux_, uy_, uz_, cos_lat_;
+};
+
+#endif  // CC_COORDS_H
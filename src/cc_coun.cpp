@@ -1,25 +1,50 @@
 #include <Rcpp.h>
 #include <cmath>
+#include <vector>
 
-using namespace Rcpp;
-
-// Inline function to calculate the Haversine distance between two geographic points
-inline double haversine_distance(double lat1, double lon1, double lat2, double lon2) {
-  const double EARTH_RADIUS = 6371000.0;  // Earth radius in meters
-  const double DEG_TO_RAD = M_PI / 180.0;
-
-  // Convert degrees to radians
-  double phi1 = lat1 * DEG_TO_RAD;
-  double phi2 = lat2 * DEG_TO_RAD;
-  double delta_phi = (lat2 - lat1) * DEG_TO_RAD;
-  double delta_lambda = (lon2 - lon1) * DEG_TO_RAD;
+#include "cc_coords.h"
+#include "cc_dist.h"
+#include "cc_flags.h"
+#include "cc_parallel.h"
+#include "cc_reference.h"
 
-  // Haversine formula
-  double a = sin(delta_phi / 2.0) * sin(delta_phi / 2.0) +
-    cos(phi1) * cos(phi2) * sin(delta_lambda / 2.0) * sin(delta_lambda / 2.0);
-  double c = 2 * atan2(sqrt(a), sqrt(1 - a));
+using namespace Rcpp;
 
-  return EARTH_RADIUS * c;  // Distance in meters
+// Writes the flags of records [begin, end) to out: TRUE if the record lies
+// in its country's polygons, or within buffer of them, or, for a centroid
+// reference, if a centroid of its country is within buffer. slots are from
+// CountryReference::slot. With geo, the records' geometry, centroids are
+// compared by squared chord and polygon buffers reuse cos of the latitude.
+void cc_coun_block(const double* lon, const double* lat, const int* slots, const CountryReference& countries,
+                   double buffer, R_xlen_t begin, R_xlen_t end, int* out,
+                   const RecordGeometry* geo = NULL) {
+  ChordLimit limit(buffer);
+  for (R_xlen_t i = begin; i < end; i++) {
+    bool matched = false;
+    int c = slots[i];
+    if (c >= 0 && countries.has_polygons()) {
+      int p = countries.polygon_set[c];
+      if (p >= 0) {
+        const PolygonSet& polygons = countries.polygons[p];
+        matched = geo ? polygons.within_distance(lon[i], lat[i], buffer, geo->cos_lat[i])
+                      : polygons.within_distance(lon[i], lat[i], buffer);
+      }
+    } else if (c >= 0) {
+      for (int k = countries.first[c]; k < countries.first[c + 1]; k++) {
+        int j = countries.rows[k];
+        // Haversine distance between the record's coordinates and the country's centroid
+        const UnitVector& centroid = countries.unit[j];
+        bool near = geo ? limit.within(chord2(geo->unit(i), centroid.x, centroid.y, centroid.z),
+                                       lon[i], lat[i], countries.lon[j], countries.lat[j])
+                        : limit.within(lon[i], lat[i], countries.lon[j], countries.lat[j]);
+        if (near) {
+          matched = true;
+          break;  // No need to check other centroids once matched
+        }
+      }
+    }
+    out[i] = matched;  // Records without a match are outside the country
+  }
 }
 
 // [[Rcpp::export]]
@@ -27,83 +52,69 @@ Rcpp::DataFrame cc_coun_cpp(Rcpp::DataFrame x,
                             std::string lon_col = "decimalLongitude",
                             std::string lat_col = "decimalLatitude",
                             std::string iso3_col = "countryCode",
-                            Rcpp::Nullable<Rcpp::NumericVector> country_lon_centroids = R_NilValue,
+                            SEXP country_lon_centroids = R_NilValue,  // or country polygons, or a cc_build_reference() handle
                             Rcpp::Nullable<Rcpp::NumericVector> country_lat_centroids = R_NilValue,
                             Rcpp::Nullable<Rcpp::StringVector> country_iso3_codes = R_NilValue,
                             double buffer = 0.0,
                             std::string value = "clean",
-                            bool verbose = true) {
+                            bool verbose = true,
+                            int nthreads = 1) {
 
-  // Extract longitude, latitude, and ISO3 columns from the input DataFrame
-  Rcpp::NumericVector lon = x[lon_col];
-  Rcpp::NumericVector lat = x[lat_col];
+  // Coordinates of the input DataFrame, read in place, and its ISO3 column
+  CoordView coords(x, lon_col, lat_col);
   Rcpp::StringVector iso3 = x[iso3_col];
 
-  // Initialize vectors for centroids and iso3 codes
-  Rcpp::NumericVector lon_centroids, lat_centroids;
-  Rcpp::StringVector iso3_codes;
-
-  // Handle Nullable arguments and convert them into NumericVector if provided
-  if (country_lon_centroids.isNotNull()) {
-    lon_centroids = Rcpp::as<Rcpp::NumericVector>(country_lon_centroids);
-  } else {
-    stop("Country longitude centroids not provided.");
-  }
-
-  if (country_lat_centroids.isNotNull()) {
-    lat_centroids = Rcpp::as<Rcpp::NumericVector>(country_lat_centroids);
-  } else {
-    stop("Country latitude centroids not provided.");
-  }
-
-  if (country_iso3_codes.isNotNull()) {
-    iso3_codes = Rcpp::as<Rcpp::StringVector>(country_iso3_codes);
-  } else {
-    stop("Country ISO3 codes not provided.");
+  std::unique_ptr<Reference> owned;
+  if (TYPEOF(country_lon_centroids) == VECSXP) {
+    // A list of country polygons
+    owned = build_reference("countries", country_lon_centroids);
+  } else if (!is_reference(country_lon_centroids)) {
+    // Handle Nullable arguments and convert them into NumericVector if provided
+    if (Rf_isNull(country_lon_centroids)) {
+      stop("Country longitude centroids not provided.");
+    }
+    if (country_lat_centroids.isNull()) {
+      stop("Country latitude centroids not provided.");
+    }
+    if (country_iso3_codes.isNull()) {
+      stop("Country ISO3 codes not provided.");
+    }
+    owned.reset(new CountryReference("countries", country_lon_centroids,
+                                     Rcpp::as<Rcpp::NumericVector>(country_lat_centroids),
+                                     Rcpp::as<Rcpp::StringVector>(country_iso3_codes)));
   }
+  const CountryReference& countries = owned
+    ? static_cast<const CountryReference&>(*owned)
+    : get_reference<CountryReference>(country_lon_centroids, "countries", owned);
 
-  int n = lon.size();  // Number of records in the input DataFrame
-  int country_count = iso3_codes.size();
-
+  int n = coords.size();  // Number of records in the input DataFrame
   Rcpp::LogicalVector within_country(n, false);  // Vector to store whether each record is within the correct country
 
-  // Iterate over each record in the data
+  // Resolve each record's code to its country slot once; CHARSXPs are read
+  // in place, so no strings are built per record
+  std::vector<int> slots(n);
+  const SEXP* codes = STRING_PTR_RO(iso3);
   for (int i = 0; i < n; i++) {
-    std::string record_iso3 = Rcpp::as<std::string>(iso3[i]);
-    bool matched = false;
-
-    // Check each country polygon's centroid
-    for (int j = 0; j < country_count; j++) {
-      std::string country_iso3 = Rcpp::as<std::string>(iso3_codes[j]);
-
-      if (record_iso3 == country_iso3) {
-        // Calculate the Haversine distance between the record's coordinates and the country's centroid
-        double distance = haversine_distance(lat[i], lon[i], lat_centroids[j], lon_centroids[j]);
-
-        // If a buffer is defined, check if the distance is within the buffer zone
-        if (distance <= buffer) {
-          within_country[i] = true;
-          matched = true;
-          break;  // No need to check other countries once matched
-        }
-      }
-    }
-
-    // If no match is found, the record is considered outside the country
-    if (!matched) {
-      within_country[i] = false;
-    }
+    slots[i] = countries.slot(codes[i]);
   }
 
+  const double* px = coords.lon();
+  const double* py = coords.lat();
+  int* flags = within_country.begin();
+  cc_parallel_for(n, nthreads, [&](R_xlen_t begin, R_xlen_t end) {
+    cc_coun_block(px, py, slots.data(), countries, buffer, begin, end, flags);
+  });
+
   // Verbose output
   if (verbose) {
     int flagged = std::count(within_country.begin(), within_country.end(), false);
     Rcpp::Rcout << "Flagged " << flagged << " records." << std::endl;
   }
 
-  // Return the cleaned data or flagged data depending on the 'value' parameter
+  // Return the rows of the clean records, or the flags, depending on the
+  // 'value' parameter
   if (value == "clean") {
-    return x[within_country];
+    return Rcpp::DataFrame::create(Rcpp::Named("rows") = flag_rows(within_country.begin(), n));
   } else {
     return Rcpp::DataFrame::create(Rcpp::Named("flagged") = within_country);
   }
@@ -3,13 +3,22 @@
 
 #include <cmath>
 #include <Rcpp.h>
+#include "cc_coords.h"
+#include "cc_reference.h"
 using namespace Rcpp;
 
 Rcpp::DataFrame cc_coun_cpp(Rcpp::DataFrame x, std::string lon_col = "decimalLongitude",
                             std::string lat_col = "decimalLatitude", std::string iso3_col = "countryCode",
-                            Rcpp::Nullable<Rcpp::NumericVector> country_lon_centroids = R_NilValue,
+                            SEXP country_lon_centroids = R_NilValue,
                             Rcpp::Nullable<Rcpp::NumericVector> country_lat_centroids = R_NilValue,
                             Rcpp::Nullable<Rcpp::StringVector> country_iso3_codes = R_NilValue,
-                            double buffer = 0.0, std::string value = "clean", bool verbose = true);
+                            double buffer = 0.0, std::string value = "clean", bool verbose = true,
+                            int nthreads = 1);
+
+// Writes the flags of records [begin, end) to out; slots holds each record's
+// country slot from CountryReference::slot, and geo, if given, its geometry
+void cc_coun_block(const double* lon, const double* lat, const int* slots, const CountryReference& countries,
+                   double buffer, R_xlen_t begin, R_xlen_t end, int* out,
+                   const RecordGeometry* geo = NULL);
 
 #endif  // CC_COUN_H
@@ -0,0 +1,70 @@
+#include "cc_dist.h"
+
+#include <limits>
+
+// Relative and absolute slack around the squared-chord bound. Both sides of
+// the comparison carry a few ulps of rounding; pairs inside the slack are
+// rare and fall back to the exact haversine test.
+const double CHORD_REL_SLACK = 1e-8;
+const double CHORD_ABS_SLACK = 1e-20;
+
+// Slack on the latitude band, in degrees on top of the relative slack
+const double LAT_ABS_SLACK = 1e-12;
+
+// Relative slack around a planar bound: both sides use the same s, so only
+// the rounding of sqrt and the products differ
+const double PLANAR_REL_SLACK = 1e-9;
+
+ChordLimit::ChordLimit(double radius) : radius_(radius) {
+  const double infinity = std::numeric_limits<double>::infinity();
+  double half_angle = radius / (2.0 * EARTH_RADIUS);
+  if (!(radius >= 0)) {
+    // Nothing is within a negative (or missing) radius
+    inside_ = -1.0;
+    outside_ = -1.0;
+    max_dlat_ = -1.0;
+  } else if (half_angle >= 1.5707963267948966) {
+    // Half the circumference or more covers the whole sphere
+    inside_ = infinity;
+    outside_ = infinity;
+    max_dlat_ = infinity;
+  } else {
+    double s = sin(half_angle);
+    double limit = 4.0 * s * s;
+    inside_ = limit * (1.0 - CHORD_REL_SLACK) - CHORD_ABS_SLACK;
+    outside_ = limit * (1.0 + CHORD_REL_SLACK) + CHORD_ABS_SLACK;
+    max_dlat_ = radius / (EARTH_RADIUS * DEG_TO_RAD) * (1.0 + CHORD_REL_SLACK) + LAT_ABS_SLACK;
+  }
+}
+
+PlanarLimit::PlanarLimit(double radius, double scale) : radius_(radius), scale_(scale) {
+  const double infinity = std::numeric_limits<double>::infinity();
+  if (!(radius >= 0) || !(scale > 0)) {
+    // Nothing can be decided from s alone; every pair takes the exact test
+    inside_ = -1.0;
+    outside_ = infinity;
+  } else {
+    double limit = (radius / scale) * (radius / scale);
+    inside_ = limit * (1.0 - PLANAR_REL_SLACK);
+    outside_ = limit * (1.0 + PLANAR_REL_SLACK);
+  }
+}
+
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__) && defined(__linux__) && __GNUC__ >= 6
+#define CC_SIMD_CLONES __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define CC_SIMD_CLONES
+#endif
+
+CC_SIMD_CLONES
+void chord2_batch(const double* x, const double* y, const double* z, std::size_t n,
+                  const UnitVector& q, double* out) {
+  double qx = q.x, qy = q.y, qz = q.z;
+#ifdef _OPENMP
+  #pragma omp simd
+#endif
+  for (std::size_t i = 0; i < n; i++) {
+    double dx = x[i] - qx, dy = y[i] - qy, dz = z[i] - qz;
+    out[i] = dx * dx + dy * dy + dz * dz;
+  }
+}
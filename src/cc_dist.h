@@ -0,0 +1,119 @@
+#ifndef CC_DIST_H
+#define CC_DIST_H
+
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+
+const double EARTH_RADIUS = 6371000.0;  // Earth radius in meters
+const double DEG_TO_RAD = 3.14159265358979323846 / 180.0;
+const double METERS_PER_DEGREE = 111319.9;  // meters per degree of latitude, for planar approximations
+
+// Great-circle distance in meters between two points (haversine formula).
+// This is the one definition every geodesic test compares against.
+inline double haversine_distance(double lon1, double lat1, double lon2, double lat2) {
+  double phi1 = lat1 * DEG_TO_RAD;
+  double phi2 = lat2 * DEG_TO_RAD;
+  double s_phi = sin((phi2 - phi1) / 2.0);
+  double s_lambda = sin((lon2 - lon1) * DEG_TO_RAD / 2.0);
+
+  double a = s_phi * s_phi + cos(phi1) * cos(phi2) * s_lambda * s_lambda;
+  return 2.0 * EARTH_RADIUS * atan2(sqrt(a), sqrt(1.0 - a));
+}
+
+// Point on the unit sphere. The squared chord between two of them is 4a,
+// with a the haversine term, so it orders pairs exactly like the distance.
+struct UnitVector {
+  double x, y, z;
+};
+
+inline UnitVector unit_vector(double lon, double lat) {
+  double phi = lat * DEG_TO_RAD;
+  double lambda = lon * DEG_TO_RAD;
+  double c = cos(phi);
+  UnitVector u = {c * cos(lambda), c * sin(lambda), sin(phi)};
+  return u;
+}
+
+inline double chord2(const UnitVector& u, double x, double y, double z) {
+  double dx = u.x - x, dy = u.y - y, dz = u.z - z;
+  return dx * dx + dy * dy + dz * dz;
+}
+
+// A great-circle radius as a bound on squared chords. Squared chords well
+// inside or outside the bound decide the test without trigonometry; those
+// within rounding distance of it are settled with haversine_distance, so the
+// result always equals haversine_distance(...) <= radius.
+class ChordLimit {
+public:
+  explicit ChordLimit(double radius);
+
+  double radius() const { return radius_; }
+
+  // 1 if a pair with this squared chord is certainly within the radius, 0 if
+  // certainly not, -1 if it has to be checked exactly (or is not a number)
+  int classify(double chord2) const {
+    if (chord2 <= inside_) return 1;
+    if (chord2 > outside_) return 0;
+    return -1;
+  }
+
+  bool within(double chord2, double lon1, double lat1, double lon2, double lat2) const {
+    int sure = classify(chord2);
+    return sure >= 0 ? sure == 1 : haversine_distance(lon1, lat1, lon2, lat2) <= radius_;
+  }
+
+  // True if the latitudes alone put the pair beyond the radius, as the
+  // great-circle distance is at least the meridian distance (which only
+  // holds for latitudes within +-90)
+  bool beyond_lat(double lat1, double lat2) const {
+    return std::abs(lat1 - lat2) > max_dlat_ && std::abs(lat1) <= 90 && std::abs(lat2) <= 90;
+  }
+
+  // Same as haversine_distance(...) <= radius for pairs without cached unit
+  // vectors: the latitude band rejects most pairs before any trigonometry,
+  // and the haversine term 4a is itself a squared chord, so atan2 and sqrt
+  // only run at the boundary
+  bool within(double lon1, double lat1, double lon2, double lat2) const {
+    if (beyond_lat(lat1, lat2)) return false;
+    double phi1 = lat1 * DEG_TO_RAD;
+    double phi2 = lat2 * DEG_TO_RAD;
+    double s_phi = sin((phi2 - phi1) / 2.0);
+    double s_lambda = sin((lon2 - lon1) * DEG_TO_RAD / 2.0);
+    double a = s_phi * s_phi + cos(phi1) * cos(phi2) * s_lambda * s_lambda;
+    return within(4.0 * a, lon1, lat1, lon2, lat2);
+  }
+
+private:
+  double radius_, inside_, outside_;
+  double max_dlat_;  // degrees
+};
+
+// A planar radius as a bound on squared offsets: decides
+// sqrt(s) * scale <= radius from s = dx * dx + dy * dy, with scale the
+// meters (or 1) per unit of offset. s well inside or outside the bound needs
+// no sqrt; the rest is settled by that very expression, so flags match it.
+class PlanarLimit {
+public:
+  PlanarLimit(double radius, double scale);
+
+  // True if an offset of d on one axis alone puts a pair beyond the radius
+  bool beyond(double d) const { return d * d > outside_; }
+
+  bool within(double s) const {
+    if (s <= inside_) return true;
+    if (s > outside_) return false;
+    return sqrt(s) * scale_ <= radius_;
+  }
+
+private:
+  double radius_, scale_, inside_, outside_;
+};
+
+// Squared chords from q to the n unit vectors held in x, y and z, written to
+// out. Compiled for AVX-512, AVX2 and baseline x86-64 where the compiler
+// supports function multiversioning, with the variant picked at load time.
+void chord2_batch(const double* x, const double* y, const double* z, std::size_t n,
+                  const UnitVector& q, double* out);
+
+#endif  // CC_DIST_H
@@ -1,28 +1,151 @@
 #include <Rcpp.h>
+#include <cstring>
+#include <stdint.h>
+#include <vector>
+
+#include "cc_coords.h"
+#include "cc_parallel.h"
+#include "cc_species.h"
 using namespace Rcpp;
 
-// [[Rcpp::export]]
-LogicalVector cc_dupl_cpp(NumericVector lon, NumericVector lat, CharacterVector species, List additions) {
-  int n = lon.size();
-  LogicalVector result(n, true);
+// Partitions per thread: more than one, so uneven partitions balance out
+const int DUPL_PARTITIONS_PER_THREAD = 8;
+
+// Bits of a coordinate as compared for duplicates: 0 and -0 are the same, as
+// are all NAs and all other NaNs, like duplicated() in R
+inline uint64_t coordinate_bits(double x) {
+  if (x == 0) {
+    x = 0;
+  } else if (ISNAN(x)) {
+    x = R_IsNA(x) ? NA_REAL : R_NaN;
+  }
+  uint64_t bits;
+  std::memcpy(&bits, &x, sizeof(bits));
+  return bits;
+}
+
+inline uint64_t mix(uint64_t h, uint64_t v) {
+  h ^= v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  return h;
+}
 
-  std::unordered_map<std::string, int> record_map;
+// Key of a record: the bits of its coordinates, its species id and R's
+// cached CHARSXPs of its additional columns, so equal strings share a pointer
+struct RecordKeys {
+  const double* lon;
+  const double* lat;
+  const int* species;
+  std::vector<const SEXP*> strings;
 
-  for (int i = 0; i < n; ++i) {
-    std::ostringstream record;
-    record << lon[i] << "," << lat[i] << "," << as<std::string>(species[i]);
+  uint64_t hash(int i) const {
+    uint64_t h = mix(coordinate_bits(lon[i]), coordinate_bits(lat[i]));
+    h = mix(h, (uint64_t) species[i]);
+    for (size_t c = 0; c < strings.size(); c++) {
+      h = mix(h, (uint64_t) (uintptr_t) strings[c][i]);
+    }
+    return h;
+  }
 
-    for (int j = 0; j < additions.size(); ++j) {
-      CharacterVector addition = additions[j];
-      record << "," << as<std::string>(addition[i]);
+  bool equal(int i, int j) const {
+    if (species[i] != species[j] ||
+        coordinate_bits(lon[i]) != coordinate_bits(lon[j]) ||
+        coordinate_bits(lat[i]) != coordinate_bits(lat[j])) {
+      return false;
     }
+    for (size_t c = 0; c < strings.size(); c++) {
+      if (strings[c][i] != strings[c][j]) return false;
+    }
+    return true;
+  }
+};
 
-    if (record_map.find(record.str()) != record_map.end()) {
-      result[i] = false;
-    } else {
-      record_map[record.str()] = 1;
+// Flags every record of a partition whose key already occurred earlier in it.
+// rows are in record order, so the first occurrence is the one kept.
+static void flag_partition(const RecordKeys& keys, const uint64_t* hashes, const int* rows, int n_rows,
+                           int* out) {
+  size_t capacity = 16;
+  while (capacity < 2 * (size_t) n_rows) capacity <<= 1;
+  std::vector<int> table(capacity, -1);  // open addressing, linear probing
+  size_t mask = capacity - 1;
+
+  for (int r = 0; r < n_rows; r++) {
+    int i = rows[r];
+    size_t slot = hashes[i] & mask;
+    while (true) {
+      int j = table[slot];
+      if (j < 0) {
+        table[slot] = i;
+        break;
+      }
+      if (hashes[j] == hashes[i] && keys.equal(i, j)) {
+        out[i] = false;
+        break;
+      }
+      slot = (slot + 1) & mask;
     }
   }
+}
+
+// Flags (FALSE) repeated records, with species taken from an interned column
+LogicalVector cc_dupl_grouped(const CoordView& coords, const SpeciesIndex& species,
+                              List additions, int nthreads) {
+  int n = coords.size();
+  LogicalVector result(n, true);
+
+  // Additional columns are compared as character, as before
+  std::vector<CharacterVector> columns;
+  for (int j = 0; j < additions.size(); ++j) {
+    CharacterVector addition = additions[j];
+    columns.push_back(addition);
+  }
+
+  RecordKeys keys;
+  keys.lon = coords.lon();
+  keys.lat = coords.lat();
+  keys.species = species.ids();
+  for (size_t c = 0; c < columns.size(); c++) {
+    keys.strings.push_back(STRING_PTR_RO(columns[c]));
+  }
+
+  std::vector<uint64_t> hashes(n);
+  cc_parallel_for(n, nthreads, [&](R_xlen_t begin, R_xlen_t end) {
+    for (R_xlen_t i = begin; i < end; i++) {
+      hashes[i] = keys.hash((int) i);
+    }
+  });
+
+  // Equal keys have equal hashes, so partitioning by the top hash bits keeps
+  // duplicates together and lets each partition be checked on its own
+  int partitions = 1, shift = 64;
+  while (partitions < cc_threads(nthreads) * DUPL_PARTITIONS_PER_THREAD && partitions < n / 1024) {
+    partitions <<= 1;
+    shift--;
+  }
+
+  std::vector<int> first(partitions + 1, 0);
+  std::vector<int> rows(n);
+  for (int i = 0; i < n; i++) {
+    first[(partitions > 1 ? hashes[i] >> shift : 0) + 1]++;
+  }
+  for (int p = 0; p < partitions; p++) first[p + 1] += first[p];
+  std::vector<int> fill(first.begin(), first.end() - 1);
+  for (int i = 0; i < n; i++) {
+    rows[fill[partitions > 1 ? hashes[i] >> shift : 0]++] = i;
+  }
+
+  int* out = result.begin();
+  cc_parallel_tasks(partitions, nthreads, [&](int p) {
+    flag_partition(keys, hashes.data(), rows.data() + first[p], first[p + 1] - first[p], out);
+  });
 
   return result;
 }
+
+// [[Rcpp::export]]
+LogicalVector cc_dupl_cpp(NumericVector lon, NumericVector lat, CharacterVector species, List additions,
+                          int nthreads = 1) {
+  return cc_dupl_grouped(CoordView(lon, lat), SpeciesIndex(species), additions, nthreads);
+}
@@ -2,8 +2,13 @@
 #define CC_DUPL_H
 
 #include <Rcpp.h>
+#include "cc_coords.h"
+#include "cc_species.h"
 using namespace Rcpp;
 
-LogicalVector cc_dupl_cpp(NumericVector lon, NumericVector lat, CharacterVector species, List additions);
+LogicalVector cc_dupl_cpp(NumericVector lon, NumericVector lat, CharacterVector species, List additions,
+                          int nthreads = 1);
+LogicalVector cc_dupl_grouped(const CoordView& coords, const SpeciesIndex& species,
+                              List additions, int nthreads = 1);
 
 #endif  // CC_DUPL_H
@@ -1,23 +1,35 @@
 #include <Rcpp.h>
+#include <cmath>
+
+#include "cc_parallel.h"
 using namespace Rcpp;
 
+void cc_equ_block(const double* lon, const double* lat, bool absolute,
+                  R_xlen_t begin, R_xlen_t end, int* out) {
+  if (absolute) {
+    for (R_xlen_t i = begin; i < end; ++i) {
+      out[i] = std::abs(lon[i]) != std::abs(lat[i]);
+    }
+  } else {
+    for (R_xlen_t i = begin; i < end; ++i) {
+      out[i] = lon[i] != lat[i];
+    }
+  }
+}
+
 // [[Rcpp::export]]
-LogicalVector cc_equ_cpp(NumericVector lon, NumericVector lat, std::string test) {
+LogicalVector cc_equ_cpp(NumericVector lon, NumericVector lat, std::string test, int nthreads = 1) {
   int n = lon.size();
   LogicalVector result(n, true);
+  const double* x = lon.begin();
+  const double* y = lat.begin();
+  int* out = result.begin();
 
-  if (test == "absolute") {
-    for (int i = 0; i < n; ++i) {
-      if (std::abs(lon[i]) == std::abs(lat[i])) {
-        result[i] = false;
-      }
-    }
-  } else if (test == "identical") {
-    for (int i = 0; i < n; ++i) {
-      if (lon[i] == lat[i]) {
-        result[i] = false;
-      }
-    }
+  if (test == "absolute" || test == "identical") {
+    bool absolute = test == "absolute";
+    cc_parallel_for(n, nthreads, [&](R_xlen_t begin, R_xlen_t end) {
+      cc_equ_block(x, y, absolute, begin, end, out);
+    });
   }
 
   return result;
@@ -4,6 +4,11 @@
 #include <Rcpp.h>
 using namespace Rcpp;
 
-LogicalVector cc_equ_cpp(NumericVector lon, NumericVector lat, std::string test);
+LogicalVector cc_equ_cpp(NumericVector lon, NumericVector lat, std::string test, int nthreads = 1);
+
+// Writes the flags of records [begin, end) to out; absolute selects the
+// "absolute" test, otherwise "identical"
+void cc_equ_block(const double* lon, const double* lat, bool absolute,
+                  R_xlen_t begin, R_xlen_t end, int* out);
 
 #endif  // CC_EQU_H
@@ -0,0 +1,190 @@
+#include <Rcpp.h>
+#include <algorithm>
+#include <stdint.h>
+#include <vector>
+
+#include "cc_flags.h"
+using namespace Rcpp;
+
+FlagSet::FlagSet(R_xlen_t n, CharacterVector tests)
+  : n_(n), n_words_((n + FLAG_WORD_BITS - 1) / FLAG_WORD_BITS), n_tests_(tests.size()) {
+  data_ = RawVector((R_xlen_t) (n_words_ * n_tests_ * sizeof(uint64_t)));
+  words_ = reinterpret_cast<uint64_t*>(data_.begin());
+  std::fill(words_, words_ + n_words_ * n_tests_, ~(uint64_t) 0);
+  data_.attr("n") = (double) n;
+  data_.attr("tests") = tests;
+  data_.attr("class") = "cc_flags";
+}
+
+FlagSet::FlagSet(SEXP flags) {
+  if (TYPEOF(flags) != RAWSXP || !Rf_inherits(flags, "cc_flags")) {
+    stop("Expected flags of class 'cc_flags'");
+  }
+  data_ = RawVector(flags);
+  n_ = (R_xlen_t) as<double>(data_.attr("n"));
+  n_tests_ = CharacterVector(data_.attr("tests")).size();
+  n_words_ = (n_ + FLAG_WORD_BITS - 1) / FLAG_WORD_BITS;
+  if ((R_xlen_t) data_.size() != n_words_ * n_tests_ * (R_xlen_t) sizeof(uint64_t)) {
+    stop("Flags of class 'cc_flags' are damaged");
+  }
+  words_ = reinterpret_cast<uint64_t*>(data_.begin());
+}
+
+void FlagSet::pack(int t, const int* flags, R_xlen_t begin, R_xlen_t end) {
+  uint64_t* col = column(t);
+  for (R_xlen_t first = begin; first < end; first += FLAG_WORD_BITS) {
+    R_xlen_t bits = std::min(FLAG_WORD_BITS, end - first);
+    uint64_t word = bits == FLAG_WORD_BITS ? 0 : ~(uint64_t) 0 << bits;  // bits past n stay set
+    const int* from = flags + (first - begin);
+    for (R_xlen_t b = 0; b < bits; b++) {
+      word |= (uint64_t) (from[b] != 0) << b;
+    }
+    col[first / FLAG_WORD_BITS] = word;
+  }
+}
+
+void FlagSet::set_order(const std::vector<int>& order) {
+  data_.attr("order") = IntegerVector(order.begin(), order.end());
+}
+
+std::vector<uint64_t> FlagSet::summary() const {
+  std::vector<uint64_t> pass(n_words_, ~(uint64_t) 0);
+  for (int t = 0; t < n_tests_; t++) {
+    const uint64_t* col = column(t);
+    for (R_xlen_t w = 0; w < n_words_; w++) pass[w] &= col[w];
+  }
+  return pass;
+}
+
+std::vector<std::vector<uint64_t> > FlagSet::tested() const {
+  std::vector<std::vector<uint64_t> > seen(n_tests_);
+  SEXP order = data_.attr("order");
+  if (Rf_isNull(order)) return seen;
+
+  IntegerVector run(order);
+  std::vector<uint64_t> alive(n_words_, ~(uint64_t) 0);
+  for (int k = 0; k < run.size(); k++) {
+    int t = run[k];
+    if (k > 0) seen[t] = alive;
+    const uint64_t* col = column(t);
+    for (R_xlen_t w = 0; w < n_words_; w++) alive[w] &= col[w];
+  }
+  return seen;
+}
+
+LogicalVector unpack_words(const uint64_t* words, R_xlen_t n) {
+  LogicalVector out(n);
+  int* to = out.begin();
+  for (R_xlen_t i = 0; i < n; i++) {
+    to[i] = words[i / FLAG_WORD_BITS] >> (i % FLAG_WORD_BITS) & 1;
+  }
+  return out;
+}
+
+LogicalVector FlagSet::unpack(int t) const {
+  LogicalVector out(n_);
+  unpack(t, tested(), out.begin());
+  return out;
+}
+
+void FlagSet::unpack(int t, const std::vector<std::vector<uint64_t> >& seen, int* to) const {
+  const uint64_t* col = column(t);
+  for (R_xlen_t i = 0; i < n_; i++) {
+    to[i] = col[i / FLAG_WORD_BITS] >> (i % FLAG_WORD_BITS) & 1;
+  }
+  if (!seen[t].empty()) {
+    for (R_xlen_t i = 0; i < n_; i++) {
+      if (!(seen[t][i / FLAG_WORD_BITS] >> (i % FLAG_WORD_BITS) & 1)) to[i] = NA_LOGICAL;
+    }
+  }
+}
+
+LogicalMatrix FlagSet::matrix() const {
+  LogicalMatrix out(n_, n_tests_);
+  std::vector<std::vector<uint64_t> > seen = tested();
+  for (int t = 0; t < n_tests_; t++) {
+    unpack(t, seen, out.begin() + (R_xlen_t) t * n_);
+  }
+  return out;
+}
+
+int FlagSet::test_index(const std::string& test) const {
+  CharacterVector names = tests();
+  for (int t = 0; t < names.size(); t++) {
+    if (test == CHAR(STRING_ELT(names, t))) return t;
+  }
+  return -1;
+}
+
+IntegerVector flag_rows(const uint64_t* words, R_xlen_t n) {
+  R_xlen_t n_words = (n + FLAG_WORD_BITS - 1) / FLAG_WORD_BITS;
+  uint64_t tail = n % FLAG_WORD_BITS == 0 ? ~(uint64_t) 0 : ((uint64_t) 1 << (n % FLAG_WORD_BITS)) - 1;
+  R_xlen_t count = 0;
+  for (R_xlen_t w = 0; w < n_words; w++) {
+    count += __builtin_popcountll(w == n_words - 1 ? words[w] & tail : words[w]);
+  }
+
+  IntegerVector rows(count);
+  R_xlen_t k = 0;
+  for (R_xlen_t w = 0; w < n_words; w++) {
+    uint64_t bits = w == n_words - 1 ? words[w] & tail : words[w];
+    while (bits != 0) {
+      rows[k++] = (int) (w * FLAG_WORD_BITS + __builtin_ctzll(bits)) + 1;
+      bits &= bits - 1;
+    }
+  }
+  return rows;
+}
+
+IntegerVector flag_rows(const int* flags, R_xlen_t n) {
+  R_xlen_t count = std::count_if(flags, flags + n, [](int f) { return f != 0; });
+  IntegerVector rows(count);
+  R_xlen_t k = 0;
+  for (R_xlen_t i = 0; i < n; i++) {
+    if (flags[i]) rows[k++] = (int) i + 1;
+  }
+  return rows;
+}
+
+//' @title Records that passed every test
+//' @param flags flags of class "cc_flags"
+//' @return LogicalVector, TRUE for the records no test flagged
+// [[Rcpp::export]]
+LogicalVector cc_flags_summary_cpp(SEXP flags) {
+  FlagSet set(flags);
+  std::vector<uint64_t> pass = set.summary();
+  return unpack_words(pass.data(), set.size());
+}
+
+//' @title Row numbers of the records that passed every test
+//' @param flags flags of class "cc_flags"
+//' @return IntegerVector of one-based row numbers, in order
+// [[Rcpp::export]]
+IntegerVector cc_flags_rows_cpp(SEXP flags) {
+  FlagSet set(flags);
+  std::vector<uint64_t> pass = set.summary();
+  return flag_rows(pass.data(), set.size());
+}
+
+//' @title Flags of one test
+//' @param flags flags of class "cc_flags"
+//' @param test name of the test
+//' @return LogicalVector, NA for records the test skipped
+// [[Rcpp::export]]
+LogicalVector cc_flags_test_cpp(SEXP flags, std::string test) {
+  FlagSet set(flags);
+  int t = set.test_index(test);
+  if (t < 0) stop("No flags for test '" + test + "'");
+  return set.unpack(t);
+}
+
+//' @title Flags of every test
+//' @param flags flags of class "cc_flags"
+//' @return LogicalMatrix with one column per test
+// [[Rcpp::export]]
+LogicalMatrix cc_flags_matrix_cpp(SEXP flags) {
+  FlagSet set(flags);
+  LogicalMatrix out = set.matrix();
+  out.attr("dimnames") = List::create(R_NilValue, set.tests());
+  return out;
+}
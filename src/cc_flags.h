@@ -0,0 +1,89 @@
+#ifndef CC_FLAGS_H
+#define CC_FLAGS_H
+
+#include <Rcpp.h>
+#include <stdint.h>
+#include <vector>
+using namespace Rcpp;
+
+// Records per word of a packed flag column. CC_CHUNK_SIZE is a multiple of
+// it, so every parallel chunk writes whole words of its own.
+const R_xlen_t FLAG_WORD_BITS = 64;
+
+// Flags of n records for several tests, one bit per record and test, set
+// when the record passed. Column t is the words [t * n_words, (t + 1) *
+// n_words); bits past n stay set, so columns combine word by word. The words
+// live in an R raw vector of class "cc_flags", handed to R as is.
+//
+// Tests run short-circuited skip the records an earlier test flagged. Their
+// bits stay set and the run order is kept, so the skipped cells can be told
+// apart again (as NA) when the flags are unpacked.
+class FlagSet {
+public:
+  // All records passed every test
+  FlagSet(R_xlen_t n, CharacterVector tests);
+
+  // Flags made by an earlier run, as returned to R
+  explicit FlagSet(SEXP flags);
+
+  R_xlen_t size() const { return n_; }
+  int n_tests() const { return n_tests_; }
+  R_xlen_t n_words() const { return n_words_; }
+
+  uint64_t* column(int t) { return words_ + (R_xlen_t) t * n_words_; }
+  const uint64_t* column(int t) const { return words_ + (R_xlen_t) t * n_words_; }
+
+  bool get(int t, R_xlen_t i) const {
+    return column(t)[i / FLAG_WORD_BITS] >> (i % FLAG_WORD_BITS) & 1;
+  }
+  void clear(int t, R_xlen_t i) {
+    column(t)[i / FLAG_WORD_BITS] &= ~((uint64_t) 1 << (i % FLAG_WORD_BITS));
+  }
+
+  // Packs the flags of records [begin, end) into column t; flags[0] is
+  // record begin, which must start a word
+  void pack(int t, const int* flags, R_xlen_t begin, R_xlen_t end);
+
+  // Records the order the tests ran in, short-circuited
+  void set_order(const std::vector<int>& order);
+
+  // Records that passed every test: the columns ANDed word by word
+  std::vector<uint64_t> summary() const;
+
+  // Column t as a logical vector, NA where the test skipped the record
+  LogicalVector unpack(int t) const;
+
+  // All columns as a records x tests matrix, as unpack()
+  LogicalMatrix matrix() const;
+
+  // Names of the tests, in column order
+  CharacterVector tests() const { return data_.attr("tests"); }
+
+  // Index of the test named test, or -1
+  int test_index(const std::string& test) const;
+
+  // The R object holding the flags
+  SEXP object() const { return data_; }
+
+private:
+  RawVector data_;
+  uint64_t* words_;
+  R_xlen_t n_, n_words_;
+  int n_tests_;
+
+  // Per test, the words of the records still unflagged when it ran, or an
+  // empty vector when it saw every record
+  std::vector<std::vector<uint64_t> > tested() const;
+
+  // Writes column t to to as unpack() does, given tested()
+  void unpack(int t, const std::vector<std::vector<uint64_t> >& seen, int* to) const;
+};
+
+// One-based numbers of the records whose flag is set
+IntegerVector flag_rows(const uint64_t* words, R_xlen_t n);
+IntegerVector flag_rows(const int* flags, R_xlen_t n);
+
+// Unpacks the first n bits of words into a logical vector
+LogicalVector unpack_words(const uint64_t* words, R_xlen_t n);
+
+#endif  // CC_FLAGS_H
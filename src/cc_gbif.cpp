@@ -1,22 +1,40 @@
 #include <Rcpp.h>
-#include <cmath>
-
-// Inline Haversine formula calculation function
-inline double haversine(double lon1, double lat1, double lon2, double lat2) {
-  const double R = 6371000; // Radius of Earth in meters
-  const double to_rad = M_PI / 180.0;
-
-  double d_lat = (lat2 - lat1) * to_rad;
-  double d_lon = (lon2 - lon1) * to_rad;
-
-  lat1 *= to_rad;
-  lat2 *= to_rad;
-
-  double a = std::sin(d_lat / 2) * std::sin(d_lat / 2) +
-    std::sin(d_lon / 2) * std::sin(d_lon / 2) * std::cos(lat1) * std::cos(lat2);
-  double c = 2 * std::atan2(std::sqrt(a), std::sqrt(1 - a));
-
-  return R * c;
+#include <algorithm>
+
+#include "cc_coords.h"
+#include "cc_dist.h"
+#include "cc_parallel.h"
+
+// Records whose squared chords are computed per batched pass
+const R_xlen_t GBIF_BATCH = 256;
+
+void cc_gbif_block(const double* lon, const double* lat, double lon_ref, double lat_ref,
+                   double max_dist, R_xlen_t begin, R_xlen_t end, int* out,
+                   const RecordGeometry* geo = NULL) {
+  // Unit vectors of the records, unless geo holds them, then their squared
+  // chords to the reference in batched passes. The scratch arrays live on
+  // the stack of the calling thread, so no chunk allocates.
+  UnitVector ref = unit_vector(lon_ref, lat_ref);
+  ChordLimit limit(max_dist);
+  double x[GBIF_BATCH], y[GBIF_BATCH], z[GBIF_BATCH], d2[GBIF_BATCH];
+  for (R_xlen_t first = begin; first < end; first += GBIF_BATCH) {
+    R_xlen_t n = std::min(GBIF_BATCH, end - first);
+    if (geo) {
+      chord2_batch(geo->ux + first, geo->uy + first, geo->uz + first, n, ref, d2);
+    } else {
+      for (R_xlen_t k = 0; k < n; k++) {
+        UnitVector u = unit_vector(lon[first + k], lat[first + k]);
+        x[k] = u.x;
+        y[k] = u.y;
+        z[k] = u.z;
+      }
+      chord2_batch(x, y, z, n, ref, d2);
+    }
+    for (R_xlen_t k = 0; k < n; k++) {
+      R_xlen_t i = first + k;
+      out[i] = limit.within(d2[k], lon[i], lat[i], lon_ref, lat_ref);
+    }
+  }
 }
 
 // Example GBIF record validation function
@@ -26,16 +44,18 @@ Rcpp::LogicalVector cc_gbif_cpp(Rcpp::DataFrame x,
                                 std::string lat_col = "decimalLatitude",
                                 double lon_ref = 0.0,
                                 double lat_ref = 0.0,
-                                double max_dist = 100000) {
-  Rcpp::NumericVector lon = x[lon_col];
-  Rcpp::NumericVector lat = x[lat_col];
-  int n = lon.size();
+                                double max_dist = 100000,
+                                int nthreads = 1) {
+  CoordView coords(x, lon_col, lat_col);
+  R_xlen_t n = coords.size();
   Rcpp::LogicalVector is_valid(n);
+  const double* px = coords.lon();
+  const double* py = coords.lat();
+  int* out = is_valid.begin();
 
-  for (int i = 0; i < n; i++) {
-    double distance = haversine(lon[i], lat[i], lon_ref, lat_ref);
-    is_valid[i] = (distance <= max_dist);
-  }
+  cc_parallel_for(n, nthreads, [&](R_xlen_t begin, R_xlen_t end) {
+    cc_gbif_block(px, py, lon_ref, lat_ref, max_dist, begin, end, out);
+  });
 
   return is_valid;
 }
@@ -2,10 +2,18 @@
 #define CC_GBIF_H
 
 #include <Rcpp.h>
+#include "cc_coords.h"
 using namespace Rcpp;
 
 Rcpp::LogicalVector cc_gbif_cpp(Rcpp::DataFrame x, std::string lon_col = "decimalLongitude",
                                 std::string lat_col = "decimalLatitude", double lon_ref = 0.0,
-                                double lat_ref = 0.0, double max_dist = 100000);
+                                double lat_ref = 0.0, double max_dist = 100000,
+                                int nthreads = 1);
+
+// Writes the flags of records [begin, end) to out; geo, if given, holds the
+// records' geometry indexed like lon and lat
+void cc_gbif_block(const double* lon, const double* lat, double lon_ref, double lat_ref,
+                   double max_dist, R_xlen_t begin, R_xlen_t end, int* out,
+                   const RecordGeometry* geo = NULL);
 
 #endif  // CC_GBIF_H
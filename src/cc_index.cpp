@@ -0,0 +1,109 @@
+#include "cc_index.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// Search regions are widened by this relative amount so rounding in the box
+// arithmetic can never drop a reference the exact test would accept
+const double BOX_SLACK = 1e-9;
+
+template <int K>
+void KdTree<K>::build(const std::vector<Point>& pts, const std::vector<int>& ids) {
+  int n = (int) pts.size();
+  std::vector<int> perm(n);
+  for (int i = 0; i < n; i++) perm[i] = i;
+
+  axis_.assign(n, 0);
+  build_range(perm, pts, 0, n);
+
+  pts_.resize(n);
+  ids_.resize(n);
+  for (int i = 0; i < n; i++) {
+    pts_[i] = pts[perm[i]];
+    ids_[i] = ids[perm[i]];
+  }
+}
+
+template <int K>
+void KdTree<K>::build_range(std::vector<int>& perm, const std::vector<Point>& pts, int b, int e) {
+  while (e - b > LEAF_SIZE) {
+    // Split on the axis with the widest spread
+    Point lo = pts[perm[b]], hi = pts[perm[b]];
+    for (int i = b + 1; i < e; i++) {
+      const Point& p = pts[perm[i]];
+      for (int d = 0; d < K; d++) {
+        lo[d] = std::min(lo[d], p[d]);
+        hi[d] = std::max(hi[d], p[d]);
+      }
+    }
+    int a = 0;
+    for (int d = 1; d < K; d++) {
+      if (hi[d] - lo[d] > hi[a] - lo[a]) a = d;
+    }
+
+    int m = b + (e - b) / 2;
+    std::nth_element(perm.begin() + b, perm.begin() + m, perm.begin() + e,
+                     [&pts, a](int i, int j) { return pts[i][a] < pts[j][a]; });
+    axis_[m] = (unsigned char) a;
+
+    build_range(perm, pts, b, m);
+    b = m + 1;
+  }
+}
+
+template class KdTree<2>;
+template class KdTree<3>;
+
+PointIndex::PointIndex(const double* lon, const double* lat, int n)
+  : lon_(lon, lon + n), lat_(lat, lat + n), ux_(n), uy_(n), uz_(n) {
+  std::vector<KdTree<3>::Point> sphere_pts;
+  std::vector<KdTree<2>::Point> plane_pts;
+  std::vector<int> ids;
+  sphere_pts.reserve(n);
+  plane_pts.reserve(n);
+  ids.reserve(n);
+
+  for (int j = 0; j < n; j++) {
+    UnitVector u = unit_vector(lon[j], lat[j]);
+    ux_[j] = u.x;
+    uy_[j] = u.y;
+    uz_[j] = u.z;
+
+    // References with missing coordinates can never be within any distance
+    if (!std::isfinite(lon[j]) || !std::isfinite(lat[j])) continue;
+
+    KdTree<3>::Point s = {{u.x, u.y, u.z}};
+    KdTree<2>::Point p = {{lon[j], lat[j]}};
+    sphere_pts.push_back(s);
+    plane_pts.push_back(p);
+    ids.push_back(j);
+  }
+
+  sphere_.build(sphere_pts, ids);
+  plane_.build(plane_pts, ids);
+}
+
+void PointIndex::sphere_box(const UnitVector& u, double radius, KdTree<3>::Point& lo, KdTree<3>::Point& hi) {
+  // Great-circle distance d corresponds to a chord of 2 sin(d / 2R) on the
+  // unit sphere; anything beyond half the circumference covers the sphere
+  double half_angle = radius / (2.0 * EARTH_RADIUS);
+  double chord = half_angle >= 1.5707963267948966 ? 2.0 : 2.0 * sin(half_angle);
+  chord = chord * (1.0 + BOX_SLACK) + BOX_SLACK;
+
+  double c[3] = {u.x, u.y, u.z};
+  for (int d = 0; d < 3; d++) {
+    lo[d] = c[d] - chord;
+    hi[d] = c[d] + chord;
+  }
+}
+
+void PointIndex::plane_box(double lon, double lat, double half_lon, double half_lat,
+                           KdTree<2>::Point& lo, KdTree<2>::Point& hi) {
+  half_lon = half_lon * (1.0 + BOX_SLACK) + BOX_SLACK;
+  half_lat = half_lat * (1.0 + BOX_SLACK) + BOX_SLACK;
+  lo[0] = lon - half_lon;
+  hi[0] = lon + half_lon;
+  lo[1] = lat - half_lat;
+  hi[1] = lat + half_lat;
+}
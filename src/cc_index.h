@@ -0,0 +1,176 @@
+#ifndef CC_INDEX_H
+#define CC_INDEX_H
+
+#include <array>
+#include <vector>
+
+#include "cc_dist.h"
+
+// Static k-d tree over K-dimensional points. The tree is implicit: a node is a
+// contiguous range of the point array and its split point sits at the middle
+// of that range, so no child pointers are stored.
+template <int K>
+class KdTree {
+public:
+  typedef std::array<double, K> Point;
+
+  KdTree() {}
+
+  // Builds the tree; ids[i] is what the queries report for pts[i]
+  void build(const std::vector<Point>& pts, const std::vector<int>& ids);
+
+  int size() const { return (int) pts_.size(); }
+
+  // Calls visit(id) for every point inside the closed box [lo, hi] until
+  // visit returns true. Returns true if the search was stopped that way.
+  template <class Visitor>
+  bool visit_box(const Point& lo, const Point& hi, Visitor& visit) const {
+    if (pts_.empty()) return false;
+    return visit_range(0, (int) pts_.size(), lo, hi, visit);
+  }
+
+private:
+  static const int LEAF_SIZE = 8;
+
+  std::vector<Point> pts_;
+  std::vector<int> ids_;
+  std::vector<unsigned char> axis_;  // split axis, stored at the split index
+
+  void build_range(std::vector<int>& perm, const std::vector<Point>& pts, int b, int e);
+
+  static bool in_box(const Point& p, const Point& lo, const Point& hi) {
+    for (int d = 0; d < K; d++) {
+      if (!(p[d] >= lo[d] && p[d] <= hi[d])) return false;
+    }
+    return true;
+  }
+
+  template <class Visitor>
+  bool visit_range(int b, int e, const Point& lo, const Point& hi, Visitor& visit) const {
+    while (e - b > LEAF_SIZE) {
+      int m = b + (e - b) / 2;
+      int a = axis_[m];
+      double split = pts_[m][a];
+      if (in_box(pts_[m], lo, hi) && visit(ids_[m])) return true;
+      bool go_left = lo[a] <= split;
+      bool go_right = hi[a] >= split;
+      if (go_left && go_right) {
+        if (visit_range(b, m, lo, hi, visit)) return true;
+        b = m + 1;
+      } else if (go_left) {
+        e = m;
+      } else if (go_right) {
+        b = m + 1;
+      } else {
+        return false;
+      }
+    }
+    for (int i = b; i < e; i++) {
+      if (in_box(pts_[i], lo, hi) && visit(ids_[i])) return true;
+    }
+    return false;
+  }
+};
+
+// Spatial index over a set of reference coordinates (capitals, centroids,
+// institutions). Queries enumerate a conservative candidate region and leave
+// the exact distance test to the caller, so flags match a full scan.
+class PointIndex {
+public:
+  PointIndex() {}
+  PointIndex(const double* lon, const double* lat, int n);
+
+  int size() const { return (int) lon_.size(); }
+  double lon(int j) const { return lon_[j]; }
+  double lat(int j) const { return lat_[j]; }
+
+  // Squared chord between reference j and the unit vector u
+  double chord2(int j, const UnitVector& u) const { return ::chord2(u, ux_[j], uy_[j], uz_[j]); }
+
+  // True if some reference lies within haversine distance limit.radius() of
+  // lon/lat. Candidates are compared by squared chord against the cached
+  // unit vectors, with haversine_distance only for pairs at the boundary.
+  bool any_within(double lon, double lat, const ChordLimit& limit) const {
+    return any_within(unit_vector(lon, lat), lon, lat, limit);
+  }
+
+  // As any_within, with the unit vector u of lon/lat already at hand
+  bool any_within(const UnitVector& u, double lon, double lat, const ChordLimit& limit) const {
+    return batched_within(u, lon, lat, limit, [](int) { return false; });
+  }
+
+  // As any_within, ignoring every reference j for which skip(j) holds
+  template <class Skip>
+  bool any_within_except(double lon, double lat, const ChordLimit& limit, Skip skip) const {
+    return batched_within(unit_vector(lon, lat), lon, lat, limit, skip);
+  }
+
+  // Returns true as soon as pred(j) holds for a reference j whose
+  // great-circle distance to lon/lat may be within radius (meters)
+  template <class Pred>
+  bool any_within_geodesic(double lon, double lat, double radius, Pred pred) const {
+    KdTree<3>::Point lo, hi;
+    sphere_box(unit_vector(lon, lat), radius, lo, hi);
+    return sphere_.visit_box(lo, hi, pred);
+  }
+
+  // Returns true as soon as pred(j) holds for a reference j with
+  // |lon_j - lon| <= half_lon and |lat_j - lat| <= half_lat (degrees)
+  template <class Pred>
+  bool any_in_box(double lon, double lat, double half_lon, double half_lat, Pred pred) const {
+    KdTree<2>::Point lo, hi;
+    plane_box(lon, lat, half_lon, half_lat, lo, hi);
+    return plane_.visit_box(lo, hi, pred);
+  }
+
+private:
+  // Candidates of a radius query are gathered this many at a time and their
+  // squared chords computed in one chord2_batch pass
+  static const int CHORD_BATCH = 32;
+
+  std::vector<double> lon_, lat_;
+  std::vector<double> ux_, uy_, uz_;  // unit vectors, computed once per reference
+  KdTree<3> sphere_;  // unit-sphere vectors, for great-circle queries
+  KdTree<2> plane_;   // raw lon/lat degrees, for planar queries
+
+  static void sphere_box(const UnitVector& u, double radius, KdTree<3>::Point& lo, KdTree<3>::Point& hi);
+
+  // True if a reference j with !skip(j) lies within limit of u (lon/lat).
+  // The candidates in the box are gathered into a batch on the stack, and
+  // each full batch, then the rest, is compared at once; the query stops at
+  // the first batch holding a match.
+  template <class Skip>
+  bool batched_within(const UnitVector& u, double lon, double lat, const ChordLimit& limit, Skip skip) const {
+    KdTree<3>::Point lo, hi;
+    sphere_box(u, limit.radius(), lo, hi);
+    int ids[CHORD_BATCH];
+    double x[CHORD_BATCH], y[CHORD_BATCH], z[CHORD_BATCH], d2[CHORD_BATCH];
+    int count = 0;
+    auto flush = [&]() -> bool {
+      for (int k = 0; k < count; k++) {
+        x[k] = ux_[ids[k]];
+        y[k] = uy_[ids[k]];
+        z[k] = uz_[ids[k]];
+      }
+      chord2_batch(x, y, z, count, u, d2);
+      int n = count;
+      count = 0;
+      for (int k = 0; k < n; k++) {
+        int j = ids[k];
+        if (limit.within(d2[k], lon, lat, lon_[j], lat_[j])) return true;
+      }
+      return false;
+    };
+    auto gather = [&](int j) -> bool {
+      if (skip(j)) return false;
+      ids[count++] = j;
+      return count == CHORD_BATCH && flush();
+    };
+    return sphere_.visit_box(lo, hi, gather) || (count > 0 && flush());
+  }
+
+  static void plane_box(double lon, double lat, double half_lon, double half_lat,
+                        KdTree<2>::Point& lo, KdTree<2>::Point& hi);
+};
+
+#endif  // CC_INDEX_H
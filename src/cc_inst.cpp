@@ -1,28 +1,161 @@
 #include <Rcpp.h>
+#include <algorithm>
 #include <cmath>
+#include <vector>
 
-// Inline Haversine formula calculation function
-inline double haversine(double lon1, double lat1, double lon2, double lat2) {
-  const double R = 6371000; // Radius of Earth in meters
-  const double to_rad = M_PI / 180.0;
+#include "cc_coords.h"
+#include "cc_dist.h"
+#include "cc_flags.h"
+#include "cc_parallel.h"
+#include "cc_reference.h"
+#include "cc_species.h"
 
-  double d_lat = (lat2 - lat1) * to_rad;
-  double d_lon = (lon2 - lon1) * to_rad;
+using namespace Rcpp;
 
-  lat1 *= to_rad;
-  lat2 *= to_rad;
+// The two metrics of the test, as compile-time policies: near() tells whether
+// any institution in index lies within the buffer of lon/lat
+struct InstGeodesic {
+  explicit InstGeodesic(double buffer) : limit(buffer) {}
 
-  double a = std::sin(d_lat / 2) * std::sin(d_lat / 2) +
-    std::sin(d_lon / 2) * std::sin(d_lon / 2) * std::cos(lat1) * std::cos(lat2);
-  double c = 2 * std::atan2(std::sqrt(a), std::sqrt(1 - a));
+  bool near(const PointIndex& index, double lon, double lat) const {
+    return index.any_within(lon, lat, limit);
+  }
+
+  ChordLimit limit;
+};
+
+// Here the buffer has been converted to degrees, and the comparison is
+// degrees * 111000 against it, i.e. a search radius of buffer / 111000 degrees
+struct InstPlanar {
+  explicit InstPlanar(double buffer) : radius(buffer / 111000.0), limit(buffer, 111000) {}
+
+  bool near(const PointIndex& index, double lon, double lat) const {
+    return index.any_in_box(lon, lat, radius, radius, [&](int j) {
+      double d_lon = lon - index.lon(j);
+      double d_lat = lat - index.lat(j);
+      return limit.within(d_lon * d_lon + d_lat * d_lat);
+    });
+  }
+
+  double radius;
+  PlanarLimit limit;
+};
+
+template <class Metric>
+static void flag_near(const double* px, const double* py, int n, const Metric& metric, const PointIndex& index,
+                      int nthreads, int* flags) {
+  cc_parallel_for(n, nthreads, [&](R_xlen_t begin, R_xlen_t end) {
+    for (R_xlen_t i = begin; i < end; i++) {
+      flags[i] = !metric.near(index, px[i], py[i]);  // Flagged as near an institution
+    }
+  });
+}
+
+// Species groups up to this size are scanned directly by their flagged
+// records; larger ones with more than a few flagged records get an index
+const int VERIFY_SCAN_GROUP = 64;
+const int VERIFY_SCAN_FLAGGED = 4;
+
+// Clears the flag of every flagged record with another record of its species
+// within limit. Species are verified as tasks, largest group first; a species
+// with many flagged records indexes its group once and runs one radius query
+// per flagged record.
+static void verify_flagged(const double* px, const double* py, const SpeciesIndex& species,
+                           const ChordLimit& limit, int nthreads, int* flags) {
+  // Flagged records by species, in CSR form
+  int n_species = species.n_species();
+  std::vector<int> first(n_species + 1, 0);
+  for (int i = 0; i < species.size(); i++) {
+    if (!flags[i]) first[species.id(i) + 1]++;
+  }
+  for (int s = 0; s < n_species; s++) first[s + 1] += first[s];
+  std::vector<int> flagged(first.back());
+  std::vector<int> fill(first.begin(), first.end() - 1);
+  std::vector<int> order;
+  for (int i = 0; i < species.size(); i++) {
+    if (!flags[i]) flagged[fill[species.id(i)]++] = i;
+  }
+  for (int s = 0; s < n_species; s++) {
+    if (first[s + 1] > first[s]) order.push_back(s);
+  }
+  std::sort(order.begin(), order.end(), [&](int a, int b) {
+    return species.group_size(a) > species.group_size(b);
+  });
+
+  cc_parallel_tasks((int) order.size(), nthreads, [&](int t) {
+    int s = order[t];
+    const int* group = species.group(s);
+    int group_size = species.group_size(s);
+    const int* rows = flagged.data() + first[s];
+    int n_flagged = first[s + 1] - first[s];
+
+    if (group_size <= VERIFY_SCAN_GROUP || n_flagged <= VERIFY_SCAN_FLAGGED) {
+      for (int k = 0; k < n_flagged; k++) {
+        int i = rows[k];
+        for (int g = 0; g < group_size; g++) {
+          int j = group[g];
+          if (i != j && limit.within(px[i], py[i], px[j], py[j])) {
+            flags[i] = true;  // Unflag if other records are nearby
+            break;
+          }
+        }
+      }
+      return;
+    }
+
+    std::vector<double> group_lon(group_size), group_lat(group_size);
+    for (int g = 0; g < group_size; g++) {
+      group_lon[g] = px[group[g]];
+      group_lat[g] = py[group[g]];
+    }
+    PointIndex index(group_lon.data(), group_lat.data(), group_size);
+
+    cc_task_for(n_flagged, CC_CHUNK_SIZE / 16, [&, rows, group](R_xlen_t begin, R_xlen_t end) {
+      for (R_xlen_t k = begin; k < end; k++) {
+        int i = rows[k];
+        bool nearby = index.any_within_except(px[i], py[i], limit, [&](int g) { return group[g] == i; });
+        if (nearby) flags[i] = true;
+      }
+    });
+  });
+}
+
+// Flags (FALSE) records within buffer of an institution in index. With
+// verify, flagged records are cleared again when another record of the same
+// species lies within buffer * verify_mltpl.
+LogicalVector cc_inst_flags(const CoordView& coords, const SpeciesIndex& species,
+                            const PointIndex& index, double buffer, bool geod, bool verify,
+                            double verify_mltpl, int nthreads) {
+  int n = coords.size();
+  LogicalVector is_clean(n, true);  // Default to TRUE (clean)
+
+  // Convert buffer from meters to degrees if not using geodetic distance
+  if (!geod) {
+    buffer = buffer / 111000.0;  // Approximate conversion (1 degree ~ 111 km)
+  }
+
+  const double* px = coords.lon();
+  const double* py = coords.lat();
+  int* flags = is_clean.begin();
+
+  if (geod) {
+    flag_near(px, py, n, InstGeodesic(buffer), index, nthreads, flags);
+  } else {
+    flag_near(px, py, n, InstPlanar(buffer), index, nthreads, flags);
+  }
+
+  // Verification step if enabled: only records of the same species count
+  if (verify) {
+    verify_flagged(px, py, species, ChordLimit(buffer * verify_mltpl), nthreads, flags);
+  }
 
-  return R * c;
+  return is_clean;
 }
 
 // [[Rcpp::export]]
 Rcpp::List cc_inst_cpp(Rcpp::DataFrame x,
-                       Rcpp::NumericVector inst_lon,
-                       Rcpp::NumericVector inst_lat,
+                       SEXP inst_lon,  // longitudes, or a cc_build_reference() handle
+                       SEXP inst_lat,  // latitudes, unused with a handle
                        std::string lon_col = "decimalLongitude",
                        std::string lat_col = "decimalLatitude",
                        std::string species_col = "species",
@@ -31,59 +164,34 @@ Rcpp::List cc_inst_cpp(Rcpp::DataFrame x,
                        bool verify = false,
                        double verify_mltpl = 10,
                        std::string value = "clean",
-                       bool verbose = true) {
+                       bool verbose = true,
+                       int nthreads = 1) {
 
-  Rcpp::NumericVector lon = x[lon_col];
-  Rcpp::NumericVector lat = x[lat_col];
-  Rcpp::StringVector species = x[species_col];
+  CoordView coords(x, lon_col, lat_col);
 
-  int n = lon.size();
-  Rcpp::LogicalVector is_clean(n, true);  // Default to TRUE (clean)
-
-  // Convert buffer from meters to degrees if not using geodetic distance
-  if (!geod) {
-    buffer = buffer / 111000.0;  // Approximate conversion (1 degree ~ 111 km)
-  }
-
-  for (int i = 0; i < n; i++) {
-    bool flag = false;
-    for (int j = 0; j < inst_lon.size(); j++) {
-      double distance = (geod)
-      ? haversine(lon[i], lat[i], inst_lon[j], inst_lat[j])
-        : std::sqrt(std::pow(lon[i] - inst_lon[j], 2) + std::pow(lat[i] - inst_lat[j], 2)) * 111000;
-
-      if (distance <= buffer) {
-        flag = true;
-        break;
-      }
+  // Species are only read to verify
+  SpeciesIndex species;
+  if (verify) {
+    if (!x.containsElementNamed(species_col.c_str())) {
+      stop("Species column '" + species_col + "' not found");
     }
-    is_clean[i] = !flag;  // Flagged as near an institution
+    species = SpeciesIndex(Rcpp::StringVector(x[species_col]));
   }
 
-  // Verification step if enabled
-  if (verify) {
-    for (int i = 0; i < n; i++) {
-      if (!is_clean[i]) {
-        bool other_species_nearby = false;
-        for (int j = 0; j < n; j++) {
-          if (i != j && species[i] == species[j]) {
-            double distance = haversine(lon[i], lat[i], lon[j], lat[j]);
-            if (distance <= buffer * verify_mltpl) {
-              other_species_nearby = true;
-              break;
-            }
-          }
-        }
-        if (other_species_nearby) {
-          is_clean[i] = true;  // Unflag if other records are nearby
-        }
-      }
-    }
+  // Index the institutions
+  std::unique_ptr<Reference> owned;
+  if (!is_reference(inst_lon)) {
+    owned.reset(new PointReference("institutions", inst_lon, inst_lat));
   }
+  const PointIndex& index = owned
+    ? static_cast<const PointReference&>(*owned).index
+    : get_reference<PointReference>(inst_lon, "institutions", owned).index;
+
+  Rcpp::LogicalVector is_clean = cc_inst_flags(coords, species, index, buffer, geod, verify,
+                                               verify_mltpl, nthreads);
 
   if (value == "clean") {
-    Rcpp::DataFrame clean_data = x[is_clean];
-    return Rcpp::List::create(Rcpp::Named("data") = clean_data);
+    return Rcpp::List::create(Rcpp::Named("rows") = flag_rows(is_clean.begin(), is_clean.size()));
   } else {
     return Rcpp::List::create(Rcpp::Named("flags") = is_clean);
   }
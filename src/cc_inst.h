@@ -2,12 +2,19 @@
 #define CC_INST_H
 
 #include <Rcpp.h>
+#include "cc_coords.h"
+#include "cc_index.h"
+#include "cc_species.h"
 using namespace Rcpp;
 
-Rcpp::List cc_inst_cpp(Rcpp::DataFrame x, Rcpp::NumericVector inst_lon, Rcpp::NumericVector inst_lat,
+Rcpp::List cc_inst_cpp(Rcpp::DataFrame x, SEXP inst_lon, SEXP inst_lat,
                        std::string lon_col = "decimalLongitude", std::string lat_col = "decimalLatitude",
                        std::string species_col = "species", double buffer = 100, bool geod = false,
                        bool verify = false, double verify_mltpl = 10, std::string value = "clean",
-                       bool verbose = true);
+                       bool verbose = true, int nthreads = 1);
+
+LogicalVector cc_inst_flags(const CoordView& coords, const SpeciesIndex& species,
+                            const PointIndex& index, double buffer, bool geod = false, bool verify = false,
+                            double verify_mltpl = 10, int nthreads = 1);
 
 #endif  // CC_INST_H
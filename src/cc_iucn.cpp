@@ -1,65 +1,106 @@
 #include <Rcpp.h>
-#include <cmath>
+#include <algorithm>
+#include <vector>
 
-// Function to calculate whether a point is within a bounding box
-bool point_in_bbox(double lon, double lat,
-                   double min_lon, double min_lat,
-                   double max_lon, double max_lat) {
-  return (lon >= min_lon && lon <= max_lon && lat >= min_lat && lat <= max_lat);
+#include "cc_coords.h"
+#include "cc_flags.h"
+#include "cc_parallel.h"
+#include "cc_reference.h"
+#include "cc_species.h"
+
+template <bool Polygons, bool Buffered>
+static void iucn_block(const double* lon, const double* lat, const int* species, const SpeciesRanges& ranges,
+                       R_xlen_t begin, R_xlen_t end, int* out) {
+  for (R_xlen_t i = begin; i < end; i++) {
+    // FALSE marks records outside the range
+    out[i] = ranges.contains<Polygons, Buffered>(species[i], lon[i], lat[i]);
+  }
+}
+
+void cc_iucn_block(const double* lon, const double* lat, const int* species, const SpeciesRanges& ranges,
+                   R_xlen_t begin, R_xlen_t end, int* out) {
+  if (!ranges.has_polygons) {
+    iucn_block<false, false>(lon, lat, species, ranges, begin, end, out);
+  } else if (ranges.buffer > 0) {
+    iucn_block<true, true>(lon, lat, species, ranges, begin, end, out);
+  } else {
+    iucn_block<true, false>(lon, lat, species, ranges, begin, end, out);
+  }
+}
+
+template <bool Polygons, bool Buffered>
+static void iucn_grouped(const double* lon, const double* lat, const SpeciesIndex& species,
+                         const SpeciesRanges& ranges, int nthreads, int* out) {
+  // One task per species, largest first, so a species' polygon index stays in
+  // cache while its records are tested; large species are split further
+  std::vector<int> groups;
+  for (int s = 0; s < species.n_species(); s++) {
+    if (species.group_size(s) > 0) groups.push_back(s);
+  }
+  std::sort(groups.begin(), groups.end(), [&](int a, int b) {
+    return species.group_size(a) > species.group_size(b);
+  });
+
+  cc_parallel_tasks((int) groups.size(), nthreads, [&](int g) {
+    int s = groups[g];
+    const int* rows = species.group(s);
+    cc_task_for(species.group_size(s), CC_CHUNK_SIZE, [&, s, rows](R_xlen_t begin, R_xlen_t end) {
+      for (R_xlen_t k = begin; k < end; k++) {
+        int i = rows[k];
+        out[i] = ranges.contains<Polygons, Buffered>(s, lon[i], lat[i]);
+      }
+    });
+  });
+}
+
+void cc_iucn_grouped(const double* lon, const double* lat, const SpeciesIndex& species,
+                     const SpeciesRanges& ranges, int nthreads, int* out) {
+  if (!ranges.has_polygons) {
+    iucn_grouped<false, false>(lon, lat, species, ranges, nthreads, out);
+  } else if (ranges.buffer > 0) {
+    iucn_grouped<true, true>(lon, lat, species, ranges, nthreads, out);
+  } else {
+    iucn_grouped<true, false>(lon, lat, species, ranges, nthreads, out);
+  }
 }
 
 // [[Rcpp::export]]
 Rcpp::List cc_iucn_cpp(Rcpp::DataFrame x,
-                       Rcpp::List ranges, // List of ranges (each as a named list with species and bbox)
+                       SEXP ranges, // List of ranges (each as a named list with species and bbox or polygons), or a cc_build_reference() handle
                        std::string lon_col = "decimalLongitude",
                        std::string lat_col = "decimalLatitude",
                        std::string species_col = "species",
                        double buffer = 0,
                        std::string value = "clean",
-                       bool verbose = true) {
+                       bool verbose = true,
+                       int nthreads = 1) {
 
-  Rcpp::NumericVector lon = x[lon_col];
-  Rcpp::NumericVector lat = x[lat_col];
+  CoordView coords(x, lon_col, lat_col);
   Rcpp::StringVector species = x[species_col];
 
-  int n = lon.size();
+  int n = coords.size();
   Rcpp::LogicalVector is_clean(n, true);
 
+  std::unique_ptr<Reference> owned;
+  const RangeReference& range = get_reference<RangeReference>(ranges, "range", owned);
+
   if (verbose) {
     Rcpp::Rcout << "Testing natural ranges for species..." << std::endl;
   }
 
-  for (int i = 0; i < n; i++) {
-    std::string current_species = Rcpp::as<std::string>(species[i]);
-    bool found = false;
-
-    for (int j = 0; j < ranges.size(); j++) {
-      Rcpp::List range_data = ranges[j];
-      std::string range_species = Rcpp::as<std::string>(range_data["species"]);
-
-      if (range_species == current_species) {
-        double min_lon = Rcpp::as<double>(range_data["min_lon"]);
-        double min_lat = Rcpp::as<double>(range_data["min_lat"]);
-        double max_lon = Rcpp::as<double>(range_data["max_lon"]);
-        double max_lat = Rcpp::as<double>(range_data["max_lat"]);
+  // Species are interned once; the workers only see integer ids
+  SpeciesIndex species_index(species);
+  SpeciesRanges species_ranges(range, species_index, buffer);
+  const double* px = coords.lon();
+  const double* py = coords.lat();
+  int* flags = is_clean.begin();
 
-        if (buffer != 0) {
-          min_lon -= buffer / 111000.0;  // Approximate conversion from meters to degrees
-          max_lon += buffer / 111000.0;
-          min_lat -= buffer / 111000.0;
-          max_lat += buffer / 111000.0;
-        }
-
-        if (point_in_bbox(lon[i], lat[i], min_lon, min_lat, max_lon, max_lat)) {
-          found = true;
-          break;
-        }
-      }
-    }
-
-    if (!found) {
-      is_clean[i] = false;  // Mark as outside range
-    }
+  if (species_ranges.has_polygons) {
+    cc_iucn_grouped(px, py, species_index, species_ranges, nthreads, flags);
+  } else {
+    cc_parallel_for(n, nthreads, [&](R_xlen_t begin, R_xlen_t end) {
+      cc_iucn_block(px, py, species_index.ids(), species_ranges, begin, end, flags);
+    });
   }
 
   if (verbose) {
@@ -72,8 +113,7 @@ Rcpp::List cc_iucn_cpp(Rcpp::DataFrame x,
   }
 
   if (value == "clean") {
-    Rcpp::DataFrame clean_data = x[is_clean];
-    return Rcpp::List::create(Rcpp::Named("data") = clean_data);
+    return Rcpp::List::create(Rcpp::Named("rows") = flag_rows(is_clean.begin(), n));
   } else {
     return Rcpp::List::create(Rcpp::Named("flags") = is_clean);
   }
@@ -2,10 +2,22 @@
 #define CC_IUCN_H
 
 #include <Rcpp.h>
+#include "cc_reference.h"
 using namespace Rcpp;
 
-Rcpp::List cc_iucn_cpp(Rcpp::DataFrame x, Rcpp::List ranges, std::string lon_col = "decimalLongitude",
+Rcpp::List cc_iucn_cpp(Rcpp::DataFrame x, SEXP ranges, std::string lon_col = "decimalLongitude",
                        std::string lat_col = "decimalLatitude", std::string species_col = "species",
-                       double buffer = 0, std::string value = "clean", bool verbose = true);
+                       double buffer = 0, std::string value = "clean", bool verbose = true,
+                       int nthreads = 1);
+
+// Writes the flags of records [begin, end) to out; species holds each
+// record's species id
+void cc_iucn_block(const double* lon, const double* lat, const int* species, const SpeciesRanges& ranges,
+                   R_xlen_t begin, R_xlen_t end, int* out);
+
+// Writes the flags of all records to out, testing the records of one species
+// at a time
+void cc_iucn_grouped(const double* lon, const double* lat, const SpeciesIndex& species,
+                     const SpeciesRanges& ranges, int nthreads, int* out);
 
 #endif  // CC_IUCN_H
@@ -1,135 +1,206 @@
 #include <Rcpp.h>
 #include <algorithm>
 #include <cmath>
-#include <unordered_map>
+
+#include "cc_coords.h"
+#include "cc_index.h"
+#include "cc_parallel.h"
+#include "cc_species.h"
 
 using namespace Rcpp;
 
 // Inline function to calculate the median
-double inline_median(NumericVector x) {
-  NumericVector sorted_x = clone(x).sort();
-  int n = sorted_x.size();
+double inline_median(std::vector<double> x) {
+  std::sort(x.begin(), x.end());
+  int n = x.size();
   if (n % 2 == 0) {
-    return (sorted_x[n / 2 - 1] + sorted_x[n / 2]) / 2.0;
+    return (x[n / 2 - 1] + x[n / 2]) / 2.0;
   } else {
-    return sorted_x[n / 2];
+    return x[n / 2];
   }
 }
 
 // Inline function to calculate the MAD (Median Absolute Deviation)
-double inline_mad(NumericVector x) {
+double inline_mad(const std::vector<double>& x) {
   double med = inline_median(x);
-  NumericVector abs_devs = abs(x - med);
+  std::vector<double> abs_devs(x.size());
+  for (size_t i = 0; i < x.size(); i++) {
+    abs_devs[i] = std::abs(x[i] - med);
+  }
   return inline_median(abs_devs);
 }
 
 // Inline function to compute Euclidean distance
-double inline_euclidean_distance(double lon1, double lat1, double lon2, double lat2) {
+inline double inline_euclidean_distance(double lon1, double lat1, double lon2, double lat2) {
   double dx = lon2 - lon1;
   double dy = lat2 - lat1;
   return std::sqrt(dx * dx + dy * dy);
 }
 
-// [[Rcpp::export]]
-LogicalVector cc_outl_cpp(DataFrame df,
-                          std::string lon_col, std::string lat_col, std::string species_col,
-                          std::string method = "quantile", double mltpl = 1.5,
-                          double tdi = 1000, int min_occs = 7, bool intrinsic = false) {
-  NumericVector longitudes = df[lon_col];
-  NumericVector latitudes = df[lat_col];
-  CharacterVector species = df[species_col];
-
-  int n = longitudes.size();
-  LogicalVector outliers(n, false);
-
-  // Group indices by species
-  std::unordered_map<std::string, std::vector<int>> species_map;
-  for (int i = 0; i < n; ++i) {
-    species_map[as<std::string>(species[i])].push_back(i);
-  }
-
-  // Iterate through each species
-  for (const auto& entry : species_map) {
-    const std::vector<int>& indices = entry.second;
-    int species_size = indices.size();
-
-    if (species_size < min_occs) {
-      continue;
-    }
-
-    NumericVector mean_distances(species_size);
-    NumericMatrix dist_geo(species_size, species_size);
-
-    // Compute distance matrix if intrinsic is true
-    if (intrinsic) {
-      for (int i = 0; i < species_size; ++i) {
-        for (int j = i + 1; j < species_size; ++j) {
-          double dist = inline_euclidean_distance(longitudes[indices[i]], latitudes[indices[i]],
-                                                  longitudes[indices[j]], latitudes[indices[j]]);
-          dist_geo(i, j) = dist;
-          dist_geo(j, i) = dist;
-        }
-      }
+// Rows of a species handed to one task; species larger than this are split
+const int OUTL_ROWS_PER_TASK = 512;
+
+// Mean distance of every record of a species to the others. Only the
+// running sum is kept, so memory stays linear in the species size, but time
+// is quadratic: n * (n - 1) distances for a species of n records. With
+// sample_size > 0 and a larger species, distances are averaged over
+// sample_size records spread evenly over the species instead of all of them,
+// which makes it n * sample_size.
+static std::vector<double> mean_distances(const std::vector<double>& x, const std::vector<double>& y,
+                                          int sample_size) {
+  int n = x.size();
+  std::vector<int> others;
+  if (sample_size > 0 && n > sample_size) {
+    for (int k = 0; k < sample_size; k++) {
+      others.push_back((int) ((double) k * n / sample_size));
     }
+  } else {
+    for (int j = 0; j < n; j++) others.push_back(j);
+  }
 
-    // Calculate mean distances
-    for (int i = 0; i < species_size; ++i) {
+  std::vector<double> means(n);
+  cc_task_for(n, OUTL_ROWS_PER_TASK, [&](R_xlen_t begin, R_xlen_t end) {
+    for (R_xlen_t i = begin; i < end; i++) {
       double total_dist = 0.0;
       int count = 0;
-      for (int j = 0; j < species_size; ++j) {
+      for (size_t k = 0; k < others.size(); k++) {
+        int j = others[k];
         if (i != j) {
-          if (intrinsic) {
-            total_dist += dist_geo(i, j);
-          } else {
-            total_dist += inline_euclidean_distance(longitudes[indices[i]], latitudes[indices[i]],
-                                                    longitudes[indices[j]], latitudes[indices[j]]);
-          }
+          total_dist += inline_euclidean_distance(x[i], y[i], x[j], y[j]);
           count++;
         }
       }
-      mean_distances[i] = total_dist / count;
+      means[i] = total_dist / count;
+    }
+  });
+  return means;
+}
+
+// Flags records of a species with no other record within tdi. A k-d tree
+// finds the candidates in the tdi box around each record; the distance test
+// itself is the same as in a full scan.
+static void flag_isolated(const std::vector<double>& x, const std::vector<double>& y, double tdi,
+                          std::vector<char>& isolated) {
+  int n = x.size();
+  std::vector<KdTree<2>::Point> pts;
+  std::vector<int> ids;
+  for (int i = 0; i < n; i++) {
+    if (std::isfinite(x[i]) && std::isfinite(y[i])) {
+      KdTree<2>::Point p = {{x[i], y[i]}};
+      pts.push_back(p);
+      ids.push_back(i);
+    }
+  }
+  KdTree<2> tree;
+  tree.build(pts, ids);
+
+  double pad = tdi * (1.0 + 1e-9);
+  cc_task_for(n, CC_CHUNK_SIZE, [&](R_xlen_t begin, R_xlen_t end) {
+    for (int i = (int) begin; i < end; i++) {
+      KdTree<2>::Point lo = {{x[i] - pad, y[i] - pad}};
+      KdTree<2>::Point hi = {{x[i] + pad, y[i] + pad}};
+      auto near = [&](int j) {
+        return j != i && inline_euclidean_distance(x[i], y[i], x[j], y[j]) <= tdi;
+      };
+      isolated[i] = !tree.visit_box(lo, hi, near);
     }
+  });
+}
 
-    // Determine outliers based on the chosen method
-    if (method == "quantile") {
-      NumericVector sorted_mean = clone(mean_distances).sort();
-      double q75 = sorted_mean[species_size * 3 / 4];
-      double iqr = q75 - sorted_mean[species_size / 4];
-      double threshold = q75 + mltpl * iqr;
+// Flags the outliers among the records of one species
+static void flag_species(const double* longitudes, const double* latitudes, const int* indices,
+                         int species_size, const std::string& method, double mltpl, double tdi,
+                         int sampling_thresh, int* outliers) {
+  // Coordinates of the species, contiguous
+  std::vector<double> x(species_size), y(species_size);
+  for (int i = 0; i < species_size; ++i) {
+    x[i] = longitudes[indices[i]];
+    y[i] = latitudes[indices[i]];
+  }
 
-      for (int i = 0; i < species_size; ++i) {
-        if (mean_distances[i] > threshold) {
-          outliers[indices[i]] = true;
-        }
+  // Determine outliers based on the chosen method
+  if (method == "quantile") {
+    std::vector<double> mean_dist = mean_distances(x, y, sampling_thresh);
+    std::vector<double> sorted_mean = mean_dist;
+    std::sort(sorted_mean.begin(), sorted_mean.end());
+    double q75 = sorted_mean[species_size * 3 / 4];
+    double iqr = q75 - sorted_mean[species_size / 4];
+    double threshold = q75 + mltpl * iqr;
+
+    for (int i = 0; i < species_size; ++i) {
+      if (mean_dist[i] > threshold) {
+        outliers[indices[i]] = true;
       }
-    } else if (method == "mad") {
-      double median_val = inline_median(mean_distances);
-      double mad_val = inline_mad(mean_distances);
-      double threshold = median_val + mltpl * mad_val;
-
-      for (int i = 0; i < species_size; ++i) {
-        if (mean_distances[i] > threshold) {
-          outliers[indices[i]] = true;
-        }
+    }
+  } else if (method == "mad") {
+    std::vector<double> mean_dist = mean_distances(x, y, sampling_thresh);
+    double median_val = inline_median(mean_dist);
+    double mad_val = inline_mad(mean_dist);
+    double threshold = median_val + mltpl * mad_val;
+
+    for (int i = 0; i < species_size; ++i) {
+      if (mean_dist[i] > threshold) {
+        outliers[indices[i]] = true;
       }
-    } else if (method == "distance") {
-      for (int i = 0; i < species_size; ++i) {
-        double min_dist = R_PosInf;
-        for (int j = 0; j < species_size; ++j) {
-          if (i != j) {
-            double dist = (intrinsic) ? dist_geo(i, j) : inline_euclidean_distance(longitudes[indices[i]], latitudes[indices[i]],
-                           longitudes[indices[j]], latitudes[indices[j]]);
-            if (dist < min_dist) {
-              min_dist = dist;
-            }
-          }
-        }
-        if (min_dist > tdi) {
-          outliers[indices[i]] = true;
-        }
+    }
+  } else if (method == "distance") {
+    std::vector<char> isolated(species_size);
+    flag_isolated(x, y, tdi, isolated);
+    for (int i = 0; i < species_size; ++i) {
+      if (isolated[i]) {
+        outliers[indices[i]] = true;
       }
     }
   }
+}
+
+// Flags outliers (TRUE) per species of an interned species column
+LogicalVector cc_outl_grouped(const CoordView& coords, const SpeciesIndex& species,
+                              std::string method, double mltpl, double tdi, int min_occs,
+                              int sampling_thresh, int nthreads) {
+  int n = coords.size();
+  LogicalVector outliers(n, false);
+
+  // Species are independent: each is a task, largest first, and large
+  // species split their rows into further tasks that idle threads pick up
+  std::vector<int> groups;
+  for (int s = 0; s < species.n_species(); s++) {
+    if (species.group_size(s) >= min_occs) {
+      groups.push_back(s);
+    }
+  }
+  std::sort(groups.begin(), groups.end(), [&](int a, int b) {
+    return species.group_size(a) > species.group_size(b);
+  });
+
+  const double* lon = coords.lon();
+  const double* lat = coords.lat();
+  int* flags = outliers.begin();
+  cc_parallel_tasks((int) groups.size(), nthreads, [&](int g) {
+    int s = groups[g];
+    flag_species(lon, lat, species.group(s), species.group_size(s), method, mltpl, tdi, sampling_thresh, flags);
+  });
 
   return outliers;
 }
+
+// [[Rcpp::export]]
+LogicalVector cc_outl_cpp(DataFrame df,
+                          std::string lon_col, std::string lat_col, std::string species_col,
+                          std::string method = "quantile", double mltpl = 1.5,
+                          double tdi = 1000, int min_occs = 7, bool intrinsic = false,
+                          int sampling_thresh = 0, int nthreads = 1) {
+  CoordView coords(df, lon_col, lat_col);
+  CharacterVector species = df[species_col];
+
+  if (method != "quantile" && method != "mad" && method != "distance") {
+    stop("Invalid method argument");
+  }
+  // Distances are no longer cached in a matrix, so intrinsic has no effect
+  if (intrinsic) {
+    warning("'intrinsic' is deprecated and has no effect");
+  }
+
+  return cc_outl_grouped(coords, SpeciesIndex(species), method, mltpl, tdi, min_occs,
+                         sampling_thresh, nthreads);
+}
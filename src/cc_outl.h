@@ -2,10 +2,17 @@
 #define CC_OUTL_H
 
 #include <Rcpp.h>
+#include "cc_coords.h"
+#include "cc_species.h"
 using namespace Rcpp;
 
-LogicalVector cc_outl_cpp(NumericVector longitudes, NumericVector latitudes,
+LogicalVector cc_outl_cpp(DataFrame df, std::string lon_col, std::string lat_col, std::string species_col,
                           std::string method = "quantile", double mltpl = 1.5,
-                          double tdi = 1000, int min_occs = 7, bool intrinsic = false);
+                          double tdi = 1000, int min_occs = 7, bool intrinsic = false,
+                          int sampling_thresh = 0, int nthreads = 1);
+
+LogicalVector cc_outl_grouped(const CoordView& coords, const SpeciesIndex& species,
+                              std::string method, double mltpl, double tdi, int min_occs,
+                              int sampling_thresh = 0, int nthreads = 1);
 
 #endif  // CC_OUTL_H
@@ -0,0 +1,81 @@
+#ifndef CC_PARALLEL_H
+#define CC_PARALLEL_H
+
+#include <Rcpp.h>
+#include <algorithm>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Records handed to a thread at a time. Every record's flag only depends on
+// the record itself, so results do not depend on how chunks are scheduled.
+const R_xlen_t CC_CHUNK_SIZE = 4096;
+
+// Threads to use for nthreads as given by the user: 0 or less means all cores
+inline int cc_threads(int nthreads) {
+#ifdef _OPENMP
+  if (nthreads <= 0) nthreads = omp_get_num_procs();
+  return nthreads;
+#else
+  (void) nthreads;
+  return 1;
+#endif
+}
+
+// Runs body(begin, end) over [0, n) in chunks of CC_CHUNK_SIZE on the OpenMP
+// thread pool, which the runtime keeps alive and shares between all tests.
+// body must not call the R API or throw.
+template <class Body>
+void cc_parallel_for(R_xlen_t n, int nthreads, Body body) {
+  R_xlen_t n_chunks = (n + CC_CHUNK_SIZE - 1) / CC_CHUNK_SIZE;
+  int threads = (int) std::min<R_xlen_t>(cc_threads(nthreads), std::max<R_xlen_t>(n_chunks, 1));
+
+#ifdef _OPENMP
+  #pragma omp parallel for schedule(dynamic, 1) num_threads(threads)
+#endif
+  for (R_xlen_t c = 0; c < n_chunks; c++) {
+    R_xlen_t begin = c * CC_CHUNK_SIZE;
+    body(begin, std::min(n, begin + CC_CHUNK_SIZE));
+  }
+  (void) threads;
+}
+
+// Runs task(t) for t in [0, n_tasks) as OpenMP tasks. Tasks are queued in
+// order and idle threads take whatever is queued next, so queue the largest
+// first. task must not call the R API or throw.
+template <class Task>
+void cc_parallel_tasks(int n_tasks, int nthreads, Task task) {
+  int threads = std::min(cc_threads(nthreads), std::max(n_tasks, 1));
+
+#ifdef _OPENMP
+  #pragma omp parallel num_threads(threads)
+  #pragma omp single
+#endif
+  for (int t = 0; t < n_tasks; t++) {
+#ifdef _OPENMP
+    #pragma omp task firstprivate(t)
+#endif
+    task(t);
+  }
+  (void) threads;
+}
+
+// Inside a task: runs body(begin, end) over [0, n) in chunks of chunk_size,
+// each as a task of its own that idle threads can pick up, and waits for all
+// of them
+template <class Body>
+void cc_task_for(R_xlen_t n, R_xlen_t chunk_size, Body body) {
+  for (R_xlen_t begin = 0; begin < n; begin += chunk_size) {
+    R_xlen_t end = std::min(n, begin + chunk_size);
+#ifdef _OPENMP
+    #pragma omp task firstprivate(begin, end)
+#endif
+    body(begin, end);
+  }
+#ifdef _OPENMP
+  #pragma omp taskwait
+#endif
+}
+
+#endif  // CC_PARALLEL_H
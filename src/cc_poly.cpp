@@ -0,0 +1,257 @@
+#include "cc_poly.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "cc_dist.h"
+
+// Average number of edges per band in a polygon's edge index
+const int EDGES_PER_BAND = 8;
+const int MAX_BANDS = 65536;
+
+static Box merge(const Box& a, const Box& b) {
+  Box m = {std::min(a.minx, b.minx), std::min(a.miny, b.miny),
+           std::max(a.maxx, b.maxx), std::max(a.maxy, b.maxy)};
+  return m;
+}
+
+void BoxTree::build(const std::vector<Box>& boxes) {
+  nodes_.clear();
+  int n = (int) boxes.size();
+  if (n == 0) return;
+
+  std::vector<int> level;
+  for (int i = 0; i < n; i++) {
+    Node leaf = {boxes[i], i, 1, true};
+    nodes_.push_back(leaf);
+    level.push_back(i);
+  }
+
+  // Sort-Tile-Recursive packing: sort by x center, cut into vertical slices of
+  // whole nodes, sort each slice by y center and group runs of NODE_SIZE
+  while (level.size() > 1) {
+    int count = (int) level.size();
+    int parents = (count + NODE_SIZE - 1) / NODE_SIZE;
+    int slices = (int) std::ceil(std::sqrt((double) parents));
+    int slice_size = slices * NODE_SIZE;
+
+    std::sort(level.begin(), level.end(), [this](int a, int b) {
+      return nodes_[a].box.minx + nodes_[a].box.maxx < nodes_[b].box.minx + nodes_[b].box.maxx;
+    });
+    for (int s = 0; s < count; s += slice_size) {
+      std::sort(level.begin() + s, level.begin() + std::min(s + slice_size, count), [this](int a, int b) {
+        return nodes_[a].box.miny + nodes_[a].box.maxy < nodes_[b].box.miny + nodes_[b].box.maxy;
+      });
+    }
+
+    // Children of a node must be contiguous, so copy each group to the end
+    std::vector<int> next;
+    for (int g = 0; g < count; g += NODE_SIZE) {
+      int first = (int) nodes_.size();
+      int size = std::min(NODE_SIZE, count - g);
+      for (int c = 0; c < size; c++) {
+        Node child = nodes_[level[g + c]];
+        nodes_.push_back(child);
+      }
+      Box box = nodes_[first].box;
+      for (int c = 1; c < size; c++) box = merge(box, nodes_[first + c].box);
+      Node parent = {box, first, size, false};
+      next.push_back((int) nodes_.size());
+      nodes_.push_back(parent);
+    }
+    level.swap(next);
+  }
+}
+
+PolygonSet::PolygonSet(List polygons) {
+  band_first_.push_back(0);
+  band_edges_.push_back(0);
+
+  std::vector<Edge> edges;
+  for (int k = 0; k < polygons.size(); k++) {
+    edges.clear();
+    bool closed = true;
+    if (Rf_isMatrix(polygons[k])) {
+      closed = add_ring(polygons[k], edges);
+    } else {
+      List rings = polygons[k];
+      for (int r = 0; r < rings.size(); r++) {
+        closed = add_ring(rings[r], edges) && closed;
+      }
+    }
+    add_polygon(edges, closed);
+  }
+
+  tree_.build(bbox_);
+}
+
+// Appends the edges of a ring, pairing vertex i with its predecessor j as the
+// ray-casting loop does. Edges with missing coordinates can never flip the
+// result, so they are dropped; returns false if any was.
+bool PolygonSet::add_ring(NumericMatrix ring, std::vector<Edge>& edges) {
+  int nvert = ring.nrow();
+  bool closed = true;
+  for (int i = 0, j = nvert - 1; i < nvert; j = i++) {
+    Edge e = {ring(i, 0), ring(i, 1), ring(j, 0), ring(j, 1)};
+    if (std::isfinite(e.xi) && std::isfinite(e.yi) && std::isfinite(e.xj) && std::isfinite(e.yj)) {
+      edges.push_back(e);
+    } else {
+      closed = false;
+    }
+  }
+  return closed;
+}
+
+void PolygonSet::add_polygon(const std::vector<Edge>& edges, bool closed) {
+  int k = size();
+  int n_edges = (int) edges.size();
+
+  Box box = {R_PosInf, R_PosInf, R_NegInf, R_NegInf};
+  for (int e = 0; e < n_edges; e++) {
+    box.minx = std::min(box.minx, std::min(edges[e].xi, edges[e].xj));
+    box.maxx = std::max(box.maxx, std::max(edges[e].xi, edges[e].xj));
+    box.miny = std::min(box.miny, std::min(edges[e].yi, edges[e].yj));
+    box.maxy = std::max(box.maxy, std::max(edges[e].yi, edges[e].yj));
+  }
+
+  // The interpolated crossing can land a few ulps outside the vertex range,
+  // so widen the x extent before using it to reject points. Points left of a
+  // closed ring cross it an even number of times; an open ring gives no such
+  // guarantee, so only its latitude range can be used.
+  if (!closed && n_edges > 0) {
+    box.minx = R_NegInf;
+    box.maxx = R_PosInf;
+  } else if (n_edges > 0) {
+    double pad = 1e-9 * (std::abs(box.minx) + std::abs(box.maxx) + (box.maxx - box.minx)) + 1e-300;
+    box.minx -= pad;
+    box.maxx += pad;
+  }
+  bbox_.push_back(box);
+
+  int n_bands = std::max(1, std::min(n_edges / EDGES_PER_BAND, MAX_BANDS));
+  double height = box.maxy - box.miny;
+  band_y0_.push_back(box.miny);
+  band_scale_.push_back(height > 0 ? n_bands / height : 0.0);
+  band_count_.push_back(n_bands);
+
+  // Count edges per band, then fill band by band
+  std::vector<int> counts(n_bands, 0);
+  for (int e = 0; e < n_edges; e++) {
+    int lo = band_of(k, std::min(edges[e].yi, edges[e].yj));
+    int hi = band_of(k, std::max(edges[e].yi, edges[e].yj));
+    for (int b = lo; b <= hi; b++) counts[b]++;
+  }
+
+  int base = band_edges_.back();
+  std::vector<int> fill(n_bands);
+  for (int b = 0; b < n_bands; b++) {
+    fill[b] = base;
+    base += counts[b];
+    band_edges_.push_back(base);
+  }
+  band_first_.push_back((int) band_edges_.size() - 1);
+
+  edges_.resize(base);
+  for (int e = 0; e < n_edges; e++) {
+    int lo = band_of(k, std::min(edges[e].yi, edges[e].yj));
+    int hi = band_of(k, std::max(edges[e].yi, edges[e].yj));
+    for (int b = lo; b <= hi; b++) edges_[fill[b]++] = edges[e];
+  }
+}
+
+// Band holding latitude y; monotone in y, so an edge registered in the bands
+// of its end points covers every y in between
+int PolygonSet::band_of(int k, double y) const {
+  double pos = std::floor((y - band_y0_[k]) * band_scale_[k]);
+  if (!(pos > 0)) return 0;
+  if (pos >= band_count_[k]) return band_count_[k] - 1;
+  return (int) pos;
+}
+
+bool PolygonSet::contains(double lon, double lat) const {
+  auto hit = [&](int k) { return in_polygon(k, lon, lat); };
+  return tree_.visit_box(lon, lat, lon, lat, hit);
+}
+
+// Ray-casting test against polygon k, restricted to the band holding y
+bool PolygonSet::in_polygon(int k, double x, double y) const {
+  int band = band_first_[k] + band_of(k, y);
+  int begin = band_edges_[band];
+  int end = band_edges_[band + 1];
+  bool inside = false;
+
+  for (int e = begin; e < end; e++) {
+    double xi = edges_[e].xi, yi = edges_[e].yi;
+    double xj = edges_[e].xj, yj = edges_[e].yj;
+
+    if (((yi > y) != (yj > y)) &&
+        (x < (xj - xi) * (y - yi) / (yj - yi) + xi)) {
+      inside = !inside;
+    }
+  }
+  return inside;
+}
+
+bool PolygonSet::within_distance(double lon, double lat, double distance) const {
+  if (contains(lon, lat)) {
+    return true;
+  }
+  if (!(distance > 0)) {
+    return false;
+  }
+  return near_edges(lon, lat, distance, cos(lat * DEG_TO_RAD));
+}
+
+bool PolygonSet::within_distance(double lon, double lat, double distance, double cos_lat) const {
+  if (contains(lon, lat)) {
+    return true;
+  }
+  if (!(distance > 0)) {
+    return false;
+  }
+  return near_edges(lon, lat, distance, cos_lat);
+}
+
+// True if an edge lies within distance of lon/lat, the point being outside
+// every polygon
+bool PolygonSet::near_edges(double lon, double lat, double distance, double cos_lat) const {
+  // Meters per degree around the point, and the degree window they allow
+  double scale_y = METERS_PER_DEGREE;
+  double scale_x = METERS_PER_DEGREE * cos_lat;
+  double half_lat = distance / scale_y * (1.0 + 1e-9);
+  double half_lon = scale_x > 1e-9 * METERS_PER_DEGREE ? distance / scale_x * (1.0 + 1e-9) : R_PosInf;
+
+  auto hit = [&](int k) {
+    return near_edge(k, lon, lat, half_lon, half_lat, scale_x, scale_y, distance);
+  };
+  return tree_.visit_box(lon - half_lon, lat - half_lat, lon + half_lon, lat + half_lat, hit);
+}
+
+// True if any edge of polygon k lies within distance of x/y
+bool PolygonSet::near_edge(int k, double x, double y, double half_lon, double half_lat,
+                           double scale_x, double scale_y, double distance) const {
+  int first = band_first_[k];
+  int begin = band_edges_[first + band_of(k, y - half_lat)];
+  int end = band_edges_[first + band_of(k, y + half_lat) + 1];
+  double limit = distance * distance;
+
+  for (int e = begin; e < end; e++) {
+    const Edge& edge = edges_[e];
+    if (std::min(edge.xi, edge.xj) > x + half_lon || std::max(edge.xi, edge.xj) < x - half_lon ||
+        std::min(edge.yi, edge.yj) > y + half_lat || std::max(edge.yi, edge.yj) < y - half_lat) {
+      continue;
+    }
+
+    // Closest point of the segment to the origin, in meters
+    double ax = (edge.xi - x) * scale_x, ay = (edge.yi - y) * scale_y;
+    double dx = (edge.xj - x) * scale_x - ax, dy = (edge.yj - y) * scale_y - ay;
+    double len2 = dx * dx + dy * dy;
+    double t = len2 > 0 ? -(ax * dx + ay * dy) / len2 : 0.0;
+    t = std::max(0.0, std::min(1.0, t));
+    double cx = ax + t * dx, cy = ay + t * dy;
+    if (cx * cx + cy * cy <= limit) {
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,106 @@
+#ifndef CC_POLY_H
+#define CC_POLY_H
+
+#include <Rcpp.h>
+#include <vector>
+using namespace Rcpp;
+
+struct Box {
+  double minx, miny, maxx, maxy;
+};
+
+// Static R-tree over boxes, bulk loaded with Sort-Tile-Recursive packing
+class BoxTree {
+public:
+  BoxTree() {}
+
+  void build(const std::vector<Box>& boxes);
+
+  // Calls visit(id) for every box intersecting [minx, maxx] x [miny, maxy]
+  // until visit returns true. Returns true if the search was stopped that way.
+  template <class Visitor>
+  bool visit_box(double minx, double miny, double maxx, double maxy, Visitor& visit) const {
+    if (nodes_.empty()) return false;
+    // Bounded by (NODE_SIZE - 1) * depth + 1 entries
+    int stack[256];
+    int top = 0;
+    stack[top++] = (int) nodes_.size() - 1;
+    while (top > 0) {
+      const Node& node = nodes_[stack[--top]];
+      if (!(node.box.minx <= maxx && node.box.maxx >= minx &&
+            node.box.miny <= maxy && node.box.maxy >= miny)) {
+        continue;
+      }
+      if (node.leaf) {
+        if (visit(node.first)) return true;
+      } else {
+        for (int c = node.first; c < node.first + node.count; c++) stack[top++] = c;
+      }
+    }
+    return false;
+  }
+
+private:
+  static const int NODE_SIZE = 16;
+
+  struct Node {
+    Box box;
+    int first, count;  // leaf: item id; otherwise children [first, first + count)
+    bool leaf;
+  };
+
+  std::vector<Node> nodes_;  // children always precede their parent; root is last
+};
+
+// Set of polygons (land masses, urban areas, species ranges) indexed for
+// point queries: an R-tree over the polygon bounding boxes picks candidate
+// polygons, and each polygon's edges are bucketed into horizontal bands so the
+// ray cast only looks at edges that can cross the query latitude.
+class PolygonSet {
+public:
+  PolygonSet() {}
+
+  // Reads a list of polygons, each an n x 2 NumericMatrix ring (lon, lat
+  // columns) or a list of such rings: the exterior and its holes. The rings of
+  // one polygon are cast against together, so points in a hole are outside.
+  explicit PolygonSet(List polygons);
+
+  int size() const { return (int) bbox_.size(); }
+
+  // True if lon/lat is inside any polygon (ray casting)
+  bool contains(double lon, double lat) const;
+
+  // True if lon/lat is inside any polygon or within distance (meters) of a
+  // polygon edge. Distances are measured in an equirectangular projection
+  // centred on the point; the R-tree and edge bands bound the edges examined.
+  bool within_distance(double lon, double lat, double distance) const;
+
+  // As within_distance, with cos of the latitude already at hand
+  bool within_distance(double lon, double lat, double distance, double cos_lat) const;
+
+private:
+  // Edge from vertex i to the previous vertex j, as in the ray-casting loop
+  struct Edge {
+    double xi, yi, xj, yj;
+  };
+
+  std::vector<Box> bbox_;
+  BoxTree tree_;
+
+  // Band b of polygon k holds edges_[band_edges_[band_first_[k] + b]] up to
+  // the next band's offset
+  std::vector<double> band_y0_, band_scale_;
+  std::vector<int> band_count_, band_first_;
+  std::vector<int> band_edges_;
+  std::vector<Edge> edges_;
+
+  static bool add_ring(NumericMatrix ring, std::vector<Edge>& edges);
+  void add_polygon(const std::vector<Edge>& edges, bool closed);
+  int band_of(int k, double y) const;
+  bool in_polygon(int k, double x, double y) const;
+  bool near_edge(int k, double x, double y, double half_lon, double half_lat,
+                 double scale_x, double scale_y, double distance) const;
+  bool near_edges(double lon, double lat, double distance, double cos_lat) const;
+};
+
+#endif  // CC_POLY_H
@@ -0,0 +1,278 @@
+#include "cc_reference.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Picks the lon/lat columns of a reference table: the named columns when a
+// data.frame has them, otherwise the first two columns of a data.frame or
+// matrix
+static void point_columns(SEXP ref, const char* lon_name, const char* lat_name,
+                          NumericVector& lon, NumericVector& lat) {
+  if (Rf_isFrame(ref)) {
+    DataFrame df(ref);
+    if (df.containsElementNamed(lon_name) && df.containsElementNamed(lat_name)) {
+      lon = df[lon_name];
+      lat = df[lat_name];
+    } else {
+      if (df.size() < 2) stop("Reference data must contain longitude and latitude columns");
+      lon = df[0];
+      lat = df[1];
+    }
+  } else if (Rf_isMatrix(ref)) {
+    NumericMatrix m(ref);
+    if (m.ncol() < 2) stop("Reference data must contain longitude and latitude columns");
+    lon = m(_, 0);
+    lat = m(_, 1);
+  } else {
+    stop("Reference data must be a matrix or data.frame");
+  }
+}
+
+CentroidReference::CentroidReference(const std::string& type, NumericVector lon, NumericVector lat, SEXP kind)
+  : PointReference(type, lon, lat) {
+  if (Rf_isNull(kind)) {
+    country = index;
+    provinces = index;
+    return;
+  }
+
+  StringVector kinds = Rf_isFactor(kind) ? StringVector(Rf_asCharacterFactor(kind)) : StringVector(kind);
+  if (kinds.size() != lon.size()) {
+    stop("Centroid types and coordinates must have the same length");
+  }
+  std::vector<double> country_lon, country_lat, province_lon, province_lat;
+  for (int j = 0; j < kinds.size(); j++) {
+    SEXP k = STRING_ELT(kinds, j);
+    if (k == NA_STRING) continue;
+    std::string name = CHAR(k);
+    if (name == "country") {
+      country_lon.push_back(lon[j]);
+      country_lat.push_back(lat[j]);
+    } else if (name == "province") {
+      province_lon.push_back(lon[j]);
+      province_lat.push_back(lat[j]);
+    }
+  }
+  country = PointIndex(country_lon.data(), country_lat.data(), (int) country_lon.size());
+  provinces = PointIndex(province_lon.data(), province_lat.data(), (int) province_lon.size());
+}
+
+RangeReference::RangeReference(const std::string& type, List ranges) : Reference(type) {
+  int n_ranges = ranges.size();
+  std::vector<std::string> names(n_ranges);
+  std::vector<double> boxes(4 * n_ranges);
+  std::vector<int> order;
+
+  // Polygon entries are gathered per species, bounding box entries sorted
+  // (the polygons stay protected as part of ranges while this runs)
+  std::unordered_map<std::string, std::vector<SEXP> > species_polygons;
+  std::vector<std::string> polygon_species;
+  for (int j = 0; j < n_ranges; j++) {
+    List range_data = ranges[j];
+    names[j] = Rcpp::as<std::string>(range_data["species"]);
+    if (range_data.containsElementNamed("polygons")) {
+      List entry = range_data["polygons"];
+      auto collected = species_polygons.insert(std::make_pair(names[j], std::vector<SEXP>()));
+      if (collected.second) polygon_species.push_back(names[j]);
+      for (int k = 0; k < entry.size(); k++) collected.first->second.push_back(entry[k]);
+      continue;
+    }
+    boxes[4 * j] = Rcpp::as<double>(range_data["min_lon"]);
+    boxes[4 * j + 1] = Rcpp::as<double>(range_data["min_lat"]);
+    boxes[4 * j + 2] = Rcpp::as<double>(range_data["max_lon"]);
+    boxes[4 * j + 3] = Rcpp::as<double>(range_data["max_lat"]);
+    order.push_back(j);
+  }
+
+  std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return names[a] < names[b]; });
+
+  for (int k = 0; k < (int) order.size(); k++) {
+    int j = order[k];
+    species.push_back(names[j]);
+    min_lon.push_back(boxes[4 * j]);
+    min_lat.push_back(boxes[4 * j + 1]);
+    max_lon.push_back(boxes[4 * j + 2]);
+    max_lat.push_back(boxes[4 * j + 3]);
+
+    std::pair<int, int>& run = runs.insert(std::make_pair(names[j], std::make_pair(k, k))).first->second;
+    run.second = k + 1;
+  }
+
+  for (size_t p = 0; p < polygon_species.size(); p++) {
+    const std::vector<SEXP>& collected = species_polygons[polygon_species[p]];
+    List species_list(collected.size());
+    for (size_t k = 0; k < collected.size(); k++) species_list[k] = collected[k];
+    polygon_of[polygon_species[p]] = (int) p;
+    polygons.push_back(PolygonSet(species_list));
+  }
+}
+
+SpeciesRanges::SpeciesRanges(const RangeReference& range, const SpeciesIndex& species, double buffer)
+  : buffer(buffer), has_polygons(false) {
+  first.push_back(0);
+  for (int s = 0; s < species.n_species(); s++) {
+    const char* name = CHAR(species.name(s));
+    auto run = range.runs.find(name);
+    if (run != range.runs.end()) {
+      for (int j = run->second.first; j < run->second.second; j++) {
+        Box box = {range.min_lon[j], range.min_lat[j], range.max_lon[j], range.max_lat[j]};
+        if (buffer != 0) {
+          // A degree of latitude is about 111 km everywhere; a degree of
+          // longitude shrinks with cos(lat), so the longitude half-width is
+          // widened for the box edge furthest from the equator. Boxes that
+          // reach that close to a pole span every longitude.
+          double dlat = buffer / 111000.0;
+          box.miny -= dlat;
+          box.maxy += dlat;
+          double edge_lat = std::min(90.0, std::max(std::fabs(box.miny), std::fabs(box.maxy)));
+          double cos_lat = std::cos(edge_lat * DEG_TO_RAD);
+          if (cos_lat * 180.0 > std::fabs(dlat)) {
+            box.minx -= dlat / cos_lat;
+            box.maxx += dlat / cos_lat;
+          } else if (dlat > 0) {
+            box.minx = -180.0;
+            box.maxx = 180.0;
+          }
+        }
+        boxes.push_back(box);
+      }
+    }
+    first.push_back((int) boxes.size());
+
+    auto polygon = range.polygon_of.find(name);
+    polygons.push_back(polygon != range.polygon_of.end() ? &range.polygons[polygon->second] : NULL);
+    has_polygons = has_polygons || polygons.back() != NULL;
+  }
+}
+
+CountryReference::CountryReference(const std::string& type, NumericVector ref_lon, NumericVector ref_lat,
+                                   StringVector ref_iso3)
+  : Reference(type), lon(ref_lon.begin(), ref_lon.end()), lat(ref_lat.begin(), ref_lat.end()) {
+  if (ref_lon.size() != ref_iso3.size() || ref_lat.size() != ref_iso3.size()) {
+    stop("Country centroids and ISO3 codes must have the same length");
+  }
+  int n_ref = ref_iso3.size();
+  std::vector<int> slots(n_ref, -1);
+  for (int j = 0; j < n_ref; j++) {
+    iso3.push_back(Rcpp::as<std::string>(ref_iso3[j]));
+    if (STRING_ELT(ref_iso3, j) != NA_STRING) slots[j] = add_slot(iso3[j]);
+    unit.push_back(unit_vector(lon[j], lat[j]));
+  }
+  group_slots(slots);
+}
+
+CountryReference::CountryReference(const std::string& type, List countries) : Reference(type) {
+  // Polygons are gathered per code (they stay protected as part of countries)
+  std::vector<std::vector<SEXP> > slot_polygons;
+  std::vector<int> slot_of_set;
+  for (int j = 0; j < countries.size(); j++) {
+    List country = countries[j];
+    std::string code = Rcpp::as<std::string>(country["iso3"]);
+    iso3.push_back(code);
+    int c = add_slot(code);
+    if (polygon_set.size() <= (size_t) c) polygon_set.resize(c + 1, -1);
+    if (polygon_set[c] < 0) {
+      polygon_set[c] = (int) slot_polygons.size();
+      slot_polygons.push_back(std::vector<SEXP>());
+    }
+    List entry = country["polygons"];
+    for (int k = 0; k < entry.size(); k++) slot_polygons[polygon_set[c]].push_back(entry[k]);
+  }
+
+  for (size_t p = 0; p < slot_polygons.size(); p++) {
+    List country_list(slot_polygons[p].size());
+    for (size_t k = 0; k < slot_polygons[p].size(); k++) country_list[k] = slot_polygons[p][k];
+    polygons.push_back(PolygonSet(country_list));
+  }
+  group_slots(std::vector<int>());
+}
+
+int CountryReference::add_slot(const std::string& code) {
+  int c = letter_slot(code.c_str());
+  if (c < 0) {
+    c = other_slots.insert(std::make_pair(code, LETTER_SLOTS + (int) other_slots.size())).first->second;
+  }
+  return c;
+}
+
+// Groups the centroids by slot with a counting sort, and sizes the slot
+// tables to cover every code seen
+void CountryReference::group_slots(const std::vector<int>& slots) {
+  int n_slots = LETTER_SLOTS + (int) other_slots.size();
+  first.assign(n_slots + 1, 0);
+  for (size_t j = 0; j < slots.size(); j++) {
+    if (slots[j] >= 0) first[slots[j] + 1]++;
+  }
+  for (size_t c = 1; c < first.size(); c++) first[c] += first[c - 1];
+  std::vector<int> fill(first.begin(), first.end() - 1);
+  rows.resize(first.back());
+  for (size_t j = 0; j < slots.size(); j++) {
+    if (slots[j] >= 0) rows[fill[slots[j]]++] = (int) j;
+  }
+  polygon_set.resize(n_slots, -1);
+}
+
+bool is_reference(SEXP x) {
+  return TYPEOF(x) == EXTPTRSXP && Rf_inherits(x, "cc_reference");
+}
+
+std::unique_ptr<Reference> build_reference(const std::string& type, SEXP ref) {
+  if (Rf_isNull(ref)) {
+    stop("No reference data provided for " + type);
+  }
+
+  NumericVector lon, lat;
+  if (type == "capitals") {
+    point_columns(ref, "capital.lon", "capital.lat", lon, lat);
+    return std::unique_ptr<Reference>(new PointReference(type, lon, lat));
+  } else if (type == "centroids") {
+    point_columns(ref, "centroid.lon", "centroid.lat", lon, lat);
+    SEXP kind = R_NilValue;
+    if (Rf_isFrame(ref) && DataFrame(ref).containsElementNamed("type")) {
+      kind = DataFrame(ref)["type"];
+    }
+    return std::unique_ptr<Reference>(new CentroidReference(type, lon, lat, kind));
+  } else if (type == "institutions") {
+    if (Rf_isFrame(ref) && DataFrame(ref).containsElementNamed("lon")) {
+      point_columns(ref, "lon", "lat", lon, lat);
+    } else {
+      point_columns(ref, "decimalLongitude", "decimalLatitude", lon, lat);
+    }
+    return std::unique_ptr<Reference>(new PointReference(type, lon, lat));
+  } else if (type == "seas" || type == "urban") {
+    return std::unique_ptr<Reference>(new PolygonReference(type, List(ref)));
+  } else if (type == "range") {
+    return std::unique_ptr<Reference>(new RangeReference(type, List(ref)));
+  } else if (type == "countries") {
+    if (!Rf_isFrame(ref)) {
+      if (TYPEOF(ref) != VECSXP) stop("Country reference must be a data.frame or a list of country polygons");
+      return std::unique_ptr<Reference>(new CountryReference(type, List(ref)));
+    }
+    point_columns(ref, "centroid.lon", "centroid.lat", lon, lat);
+    DataFrame df(ref);
+    StringVector iso3;
+    if (df.containsElementNamed("iso3")) {
+      iso3 = df["iso3"];
+    } else if (df.containsElementNamed("iso_a3")) {
+      iso3 = df["iso_a3"];
+    } else {
+      if (df.size() < 3) stop("Country reference must contain an ISO3 column");
+      iso3 = df[2];
+    }
+    return std::unique_ptr<Reference>(new CountryReference(type, lon, lat, iso3));
+  }
+  stop("Unknown reference type '" + type + "'");
+}
+
+//' @title Build a reusable reference index
+ //' @param type character, one of "capitals", "centroids", "institutions",
+ //'   "seas", "urban", "range" or "countries"
+ //' @param ref the reference data in the form the matching cc_*_cpp kernel takes
+ //' @return external pointer of class "cc_reference"
+ // [[Rcpp::export]]
+ SEXP cc_build_reference_cpp(std::string type, SEXP ref) {
+   XPtr<Reference> handle(build_reference(type, ref).release(), true);
+   handle.attr("class") = "cc_reference";
+   handle.attr("type") = type;
+   return handle;
+ }
@@ -0,0 +1,175 @@
+#ifndef CC_REFERENCE_H
+#define CC_REFERENCE_H
+
+#include <Rcpp.h>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "cc_index.h"
+#include "cc_poly.h"
+#include "cc_species.h"
+using namespace Rcpp;
+
+// Reference data converted once into native form. cc_build_reference() hands
+// it to R as an external pointer that every cc_*_cpp kernel accepts in place
+// of the raw R reference object.
+struct Reference {
+  explicit Reference(const std::string& type) : type(type) {}
+  virtual ~Reference() {}
+
+  std::string type;
+};
+
+// Capitals, centroids or institutions
+struct PointReference : Reference {
+  PointReference(const std::string& type, NumericVector lon, NumericVector lat)
+    : Reference(type), index(lon.begin(), lat.begin(), lon.size()) {}
+
+  PointIndex index;
+};
+
+// Country and province centroids. index holds them all; country and
+// provinces hold the rows of each kind, from a type column as in
+// CoordinateCleaner's countryref ("country" or "province"). Without that
+// column every centroid counts as both.
+struct CentroidReference : PointReference {
+  CentroidReference(const std::string& type, NumericVector lon, NumericVector lat, SEXP kind);
+
+  // Index for test "both", "country" or "provinces"
+  const PointIndex& select(const std::string& test) const {
+    if (test == "country") return country;
+    if (test == "provinces") return provinces;
+    return index;
+  }
+
+  PointIndex country, provinces;
+};
+
+// Land or urban polygons
+struct PolygonReference : Reference {
+  PolygonReference(const std::string& type, List polygons)
+    : Reference(type), polygons(polygons) {}
+
+  PolygonSet polygons;
+};
+
+// Species ranges as bounding boxes and/or polygons. Boxes are stored species
+// by species so each species' boxes are the run [first, last) found in runs;
+// the polygons of a species form one indexed set of its own.
+struct RangeReference : Reference {
+  RangeReference(const std::string& type, List ranges);
+
+  std::vector<std::string> species;
+  std::vector<double> min_lon, min_lat, max_lon, max_lat;
+  std::unordered_map<std::string, std::pair<int, int> > runs;
+
+  std::vector<PolygonSet> polygons;
+  std::unordered_map<std::string, int> polygon_of;
+};
+
+// Range boxes of each species of a SpeciesIndex, with the buffer applied:
+// species s owns boxes[first[s]] up to boxes[first[s + 1]], and polygons[s]
+// (NULL if none), which count within buffer meters
+struct SpeciesRanges {
+  SpeciesRanges(const RangeReference& range, const SpeciesIndex& species, double buffer);
+
+  // True if lon/lat is within the range of species s. Compiled for the
+  // kinds of ranges the tests meet: boxes only, or also polygons, with or
+  // without a buffer; callers pick the kind once.
+  template <bool Polygons, bool Buffered>
+  bool contains(int s, double lon, double lat) const {
+    for (int k = first[s]; k < first[s + 1]; k++) {
+      const Box& box = boxes[k];
+      if (lon >= box.minx && lon <= box.maxx && lat >= box.miny && lat <= box.maxy) return true;
+    }
+    if (!Polygons || polygons[s] == NULL) return false;
+    return Buffered ? polygons[s]->within_distance(lon, lat, buffer) : polygons[s]->contains(lon, lat);
+  }
+
+  std::vector<int> first;
+  std::vector<Box> boxes;
+  std::vector<const PolygonSet*> polygons;
+  double buffer;
+  bool has_polygons;
+};
+
+// Country centroids or polygons keyed by ISO3 code. Every code gets a slot:
+// three upper-case letters map straight to one of 26^3 slots, anything else
+// is looked up in a small map. The centroids of slot c are rows[first[c]] up
+// to rows[first[c + 1]]; its polygons are polygons[polygon_set[c]], or none
+// if that is -1.
+struct CountryReference : Reference {
+  CountryReference(const std::string& type, NumericVector ref_lon, NumericVector ref_lat, StringVector ref_iso3);
+
+  // Reads a list of countries, each a list with iso3 and polygons (in the
+  // form PolygonSet takes)
+  CountryReference(const std::string& type, List countries);
+
+  static const int LETTER_SLOTS = 26 * 26 * 26;
+
+  // Slot of a code (a CHARSXP), or -1 if no centroid has that code
+  int slot(SEXP code) const {
+    if (code == NA_STRING) return -1;
+    const char* c = CHAR(code);
+    int letters = letter_slot(c);
+    if (letters >= 0) return letters;
+    auto found = other_slots.find(c);
+    return found != other_slots.end() ? found->second : -1;
+  }
+
+  static int letter_slot(const char* c) {
+    for (int k = 0; k < 3; k++) {
+      if (c[k] < 'A' || c[k] > 'Z') return -1;
+    }
+    return c[3] == '\0' ? ((c[0] - 'A') * 26 + (c[1] - 'A')) * 26 + (c[2] - 'A') : -1;
+  }
+
+  std::vector<double> lon, lat;
+  std::vector<UnitVector> unit;  // of each centroid
+  std::vector<std::string> iso3;
+  std::unordered_map<std::string, int> other_slots;
+  std::vector<int> first, rows;
+
+  std::vector<PolygonSet> polygons;
+  std::vector<int> polygon_set;
+  bool has_polygons() const { return !polygons.empty(); }
+
+private:
+  int add_slot(const std::string& code);
+  void group_slots(const std::vector<int>& slots);
+};
+
+// True if x is an external pointer made by cc_build_reference()
+bool is_reference(SEXP x);
+
+// Builds the native reference of the given type from raw R data
+std::unique_ptr<Reference> build_reference(const std::string& type, SEXP ref);
+
+// Returns the reference behind handle x, or builds one of the given type from
+// raw R data into `owned` when x is not a handle. A handle built for another
+// type is rejected even when its C++ class matches (capitals and
+// institutions, seas and urban).
+template <class T>
+const T& get_reference(SEXP x, const std::string& type, std::unique_ptr<Reference>& owned) {
+  const Reference* ref;
+  if (is_reference(x)) {
+    ref = static_cast<const Reference*>(R_ExternalPtrAddr(x));
+    if (ref == NULL) {
+      stop("Reference handle is no longer valid; rebuild it with cc_build_reference()");
+    }
+  } else {
+    owned = build_reference(type, x);
+    ref = owned.get();
+  }
+
+  const T* typed = dynamic_cast<const T*>(ref);
+  if (ref->type != type || typed == NULL) {
+    stop("Reference of type '" + ref->type + "' cannot be used for " + type);
+  }
+  return *typed;
+}
+
+#endif  // CC_REFERENCE_H
@@ -1,45 +1,37 @@
 #include <Rcpp.h>
+#include "cc_coords.h"
+#include "cc_parallel.h"
+#include "cc_reference.h"
 using namespace Rcpp;
 
-// Static function to check if a point is inside a polygon using ray-casting
-static bool isPointInPolygon(double x, double y, NumericMatrix polygon) {
-  int nvert = polygon.nrow();
-  bool inside = false;
-
-  for (int i = 0, j = nvert - 1; i < nvert; j = i++) {
-    double xi = polygon(i, 0), yi = polygon(i, 1);
-    double xj = polygon(j, 0), yj = polygon(j, 1);
-
-    if (((yi > y) != (yj > y)) &&
-        (x < (xj - xi) * (y - yi) / (yj - yi) + xi)) {
-      inside = !inside;
-    }
+void cc_sea_block(const double* lon, const double* lat, const PolygonSet& polygons, double buffer,
+                  R_xlen_t begin, R_xlen_t end, int* out, const RecordGeometry* geo = NULL) {
+  for (R_xlen_t i = begin; i < end; i++) {
+    // Points within buffer meters of coast count as land
+    bool is_land = geo ? polygons.within_distance(lon[i], lat[i], buffer, geo->cos_lat[i])
+                       : polygons.within_distance(lon[i], lat[i], buffer);
+    out[i] = !is_land; // Invert to flag sea points
   }
-  return inside;
 }
 
+// coords is a data.frame with columns lon_col and lat_col, or a matrix with
+// longitude and latitude columns; either is read in place
 // [[Rcpp::export]]
-LogicalVector cc_sea_cpp(NumericMatrix coords, List land_polygons, double buffer = 0) {
-  int n_points = coords.nrow();
+LogicalVector cc_sea_cpp(SEXP coords, SEXP land_polygons, double buffer = 0, int nthreads = 1,
+                        std::string lon_col = "decimalLongitude", std::string lat_col = "decimalLatitude") {
+  CoordView view(coords, lon_col, lat_col);
+  R_xlen_t n_points = view.size();
   LogicalVector result(n_points);
+  std::unique_ptr<Reference> owned;
+  const PolygonSet& polygons = get_reference<PolygonReference>(land_polygons, "seas", owned).polygons;
 
-  // Iterate over all points
-  for (int i = 0; i < n_points; i++) {
-    double lon = coords(i, 0);
-    double lat = coords(i, 1);
-    bool is_land = false;
+  const double* x = view.lon();
+  const double* y = view.lat();
+  int* out = result.begin();
 
-    // Check if the point is inside any polygon
-    for (int j = 0; j < land_polygons.size(); j++) {
-      NumericMatrix polygon = land_polygons[j];
-
-      if (isPointInPolygon(lon, lat, polygon)) {
-        is_land = true;
-        break;
-      }
-    }
-    result[i] = !is_land; // Invert to flag sea points
-  }
+  cc_parallel_for(n_points, nthreads, [&](R_xlen_t begin, R_xlen_t end) {
+    cc_sea_block(x, y, polygons, buffer, begin, end, out);
+  });
 
   return result;
 }
@@ -2,8 +2,16 @@
 #define CC_SEA_H
 
 #include <Rcpp.h>
+#include "cc_coords.h"
+#include "cc_poly.h"
 using namespace Rcpp;
 
-LogicalVector cc_sea_cpp(NumericMatrix coords, List land_polygons, double buffer = 0);
+LogicalVector cc_sea_cpp(SEXP coords, SEXP land_polygons, double buffer = 0, int nthreads = 1,
+                        std::string lon_col = "decimalLongitude", std::string lat_col = "decimalLatitude");
+
+// Writes the flags of records [begin, end) to out; geo, if given, holds the
+// records' geometry indexed like lon and lat
+void cc_sea_block(const double* lon, const double* lat, const PolygonSet& polygons, double buffer,
+                  R_xlen_t begin, R_xlen_t end, int* out, const RecordGeometry* geo = NULL);
 
 #endif  // CC_SEA_H
@@ -0,0 +1,68 @@
+#include "cc_species.h"
+
+#include <stdint.h>
+
+static size_t pointer_hash(SEXP x) {
+  uint64_t h = (uint64_t) (uintptr_t) x;
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  return (size_t) h;
+}
+
+SpeciesIndex::SpeciesIndex(CharacterVector species) {
+  int n = species.size();
+  const SEXP* names = STRING_PTR_RO(species);
+  ids_.resize(n);
+
+  // Open addressing table from CHARSXP to id, kept at most half full
+  size_t capacity = 64;
+  std::vector<int> table(capacity, -1);
+
+  for (int i = 0; i < n; i++) {
+    SEXP name = names[i];
+    size_t slot = pointer_hash(name) & (capacity - 1);
+    while (table[slot] >= 0 && names_[table[slot]] != name) {
+      slot = (slot + 1) & (capacity - 1);
+    }
+
+    if (table[slot] < 0) {
+      if (2 * (names_.size() + 1) > capacity) {
+        capacity *= 2;
+        table.assign(capacity, -1);
+        for (size_t s = 0; s < names_.size(); s++) {
+          size_t k = pointer_hash(names_[s]) & (capacity - 1);
+          while (table[k] >= 0) k = (k + 1) & (capacity - 1);
+          table[k] = (int) s;
+        }
+        slot = pointer_hash(name) & (capacity - 1);
+        while (table[slot] >= 0) slot = (slot + 1) & (capacity - 1);
+      }
+      table[slot] = (int) names_.size();
+      names_.push_back(name);
+    }
+    ids_[i] = table[slot];
+  }
+
+  group_records();
+}
+
+SpeciesIndex::SpeciesIndex(const SpeciesIndex& all, const std::vector<int>& rows)
+  : ids_(rows.size()), names_(all.names_) {
+  for (size_t k = 0; k < rows.size(); k++) {
+    ids_[k] = all.ids_[rows[k]];
+  }
+  group_records();
+}
+
+// Counting sort of the records by species id
+void SpeciesIndex::group_records() {
+  int n = size();
+  first_.assign(n_species() + 1, 0);
+  for (int i = 0; i < n; i++) first_[ids_[i] + 1]++;
+  for (int s = 0; s < n_species(); s++) first_[s + 1] += first_[s];
+
+  std::vector<int> fill(first_.begin(), first_.end() - 1);
+  rows_.resize(n);
+  for (int i = 0; i < n; i++) rows_[fill[ids_[i]]++] = i;
+}
@@ -0,0 +1,44 @@
+#ifndef CC_SPECIES_H
+#define CC_SPECIES_H
+
+#include <Rcpp.h>
+#include <vector>
+using namespace Rcpp;
+
+// Species of every record as dense integer ids (in order of first
+// appearance), with the records of each species grouped in CSR form. R keeps
+// one CHARSXP per distinct string, so interning only hashes pointers. Built
+// once per data set and shared by every species-aware test.
+class SpeciesIndex {
+public:
+  SpeciesIndex() {}
+
+  // Interns a character vector of species names
+  explicit SpeciesIndex(CharacterVector species);
+
+  // Restriction of all to the records rows; ids stay those of all
+  SpeciesIndex(const SpeciesIndex& all, const std::vector<int>& rows);
+
+  int size() const { return (int) ids_.size(); }
+  int n_species() const { return (int) names_.size(); }
+
+  // Species id of record i, and the whole id array
+  int id(R_xlen_t i) const { return ids_[i]; }
+  const int* ids() const { return ids_.data(); }
+
+  // CHARSXP holding the name of species s
+  SEXP name(int s) const { return names_[s]; }
+
+  // Records of species s, in record order
+  int group_size(int s) const { return first_[s + 1] - first_[s]; }
+  const int* group(int s) const { return rows_.data() + first_[s]; }
+
+private:
+  std::vector<int> ids_;
+  std::vector<SEXP> names_;
+  std::vector<int> first_, rows_;
+
+  void group_records();
+};
+
+#endif  // CC_SPECIES_H
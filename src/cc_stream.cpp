@@ -0,0 +1,869 @@
+// [[Rcpp::plugins(cpp11)]]
+#include <Rcpp.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "cc_dupl.h"
+#include "cc_iucn.h"
+#include "cc_outl.h"
+#include "cc_parallel.h"
+#include "cc_reference.h"
+#include "cc_species.h"
+#include "cc_tests.h"
+#include "cc_val.h"
+
+using namespace Rcpp;
+
+// Records of the species-level tests are spilled to this many bucket files,
+// by a hash of the species name, so every species lands whole in one bucket
+// and the grouping phase holds one bucket in memory at a time. Buckets over
+// the memory budget are split the same way again, by a hash of another seed,
+// and result files are merged this many at a time.
+const int STREAM_BUCKETS = 64;
+
+// Rough memory of one record while its bucket is grouped: coordinates,
+// record number, species and the working space of the grouped tests
+const size_t BUCKET_RECORD_BYTES = 64;
+
+// Buffer of each file written, and of each bucket file
+const size_t STREAM_BUFFER = 1 << 20;
+const size_t BUCKET_BUFFER = 1 << 16;
+
+// Flags read back per block in the final pass
+const size_t FLAG_BLOCK = 1 << 16;
+
+// An open stdio file, closed when it goes out of scope
+class StreamFile {
+public:
+  StreamFile(const std::string& path, const char* mode, size_t buffer = STREAM_BUFFER)
+    : path_(path), f_(std::fopen(path.c_str(), mode)) {
+    if (f_ == NULL) stop("Cannot open '" + path + "'");
+    std::setvbuf(f_, NULL, _IOFBF, buffer);
+  }
+  ~StreamFile() {
+    if (f_ != NULL) std::fclose(f_);
+  }
+
+  void write(const void* data, size_t size) {
+    if (size > 0 && std::fwrite(data, 1, size, f_) != size) stop("Failed writing '" + path_ + "'");
+  }
+  void write(const std::string& s) { write(s.data(), s.size()); }
+
+  size_t read(void* data, size_t size) { return std::fread(data, 1, size, f_); }
+
+  void read_exactly(void* data, size_t size) {
+    if (read(data, size) != size) stop("Unexpected end of '" + path_ + "'");
+  }
+
+  // Flushes and closes the file, failing if anything could not be written
+  void close() {
+    FILE* f = f_;
+    f_ = NULL;
+    if (std::fclose(f) != 0) stop("Failed writing '" + path_ + "'");
+  }
+
+private:
+  std::string path_;
+  FILE* f_;
+
+  StreamFile(const StreamFile&);
+  StreamFile& operator=(const StreamFile&);
+};
+
+// Temporary files of one run, removed when the run ends or fails
+class SpillFiles {
+public:
+  explicit SpillFiles(const std::string& dir) : dir_(dir) {}
+  ~SpillFiles() {
+    for (size_t k = 0; k < paths_.size(); k++) std::remove(paths_[k].c_str());
+  }
+
+  // Path of a new temporary file in the spill directory
+  std::string add(const char* prefix) {
+    char* path = R_tmpnam2(prefix, dir_.c_str(), ".bin");
+    paths_.push_back(path);
+    std::free(path);
+    return paths_.back();
+  }
+
+private:
+  std::string dir_;
+  std::vector<std::string> paths_;
+};
+
+// Lines of a text file after its header, handed out a window of whole lines
+// at a time. Where mmap is available the file is mapped and windows point
+// straight into the mapping, whose pages are released once a window is done;
+// on Windows each window is read into a buffer and a partial last line is
+// carried over to the next.
+class LineReader {
+public:
+  LineReader(const std::string& path, size_t window);
+  ~LineReader();
+
+  // First line of the file, without the line break
+  const std::string& header() const { return header_; }
+
+  // Next window of whole lines as [begin, end); false at the end of the file
+  bool next(const char*& begin, const char*& end);
+
+  // Back to the first line after the header
+  void rewind();
+
+private:
+  size_t window_;
+  std::string header_;
+#ifndef _WIN32
+  int fd_;
+  const char* data_;
+  size_t size_, body_, pos_, released_;
+#else
+  FILE* f_;
+  long long body_;
+  std::vector<char> buffer_;
+  size_t used_, carry_;  // bytes handed out, and those of a partial line after them
+#endif
+
+  LineReader(const LineReader&);
+  LineReader& operator=(const LineReader&);
+};
+
+#ifndef _WIN32
+LineReader::LineReader(const std::string& path, size_t window)
+  : window_(window), fd_(-1), data_(NULL), size_(0), body_(0), pos_(0), released_(0) {
+  fd_ = open(path.c_str(), O_RDONLY);
+  if (fd_ < 0) stop("Cannot open '" + path + "'");
+  struct stat info;
+  if (fstat(fd_, &info) != 0) {
+    ::close(fd_);
+    stop("Cannot read '" + path + "'");
+  }
+  size_ = (size_t) info.st_size;
+  if (size_ > 0) {
+    void* mapped = mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+    if (mapped == MAP_FAILED) {
+      ::close(fd_);
+      stop("Cannot map '" + path + "'");
+    }
+    data_ = static_cast<const char*>(mapped);
+    madvise(mapped, size_, MADV_SEQUENTIAL);
+  }
+
+  const char* nl = size_ > 0 ? static_cast<const char*>(std::memchr(data_, '\n', size_)) : NULL;
+  size_t header_end = nl != NULL ? (size_t) (nl - data_) : size_;
+  header_.assign(data_ != NULL ? data_ : "", header_end);
+  body_ = pos_ = nl != NULL ? header_end + 1 : size_;
+  if (!header_.empty() && header_[header_.size() - 1] == '\r') header_.resize(header_.size() - 1);
+}
+
+LineReader::~LineReader() {
+  if (data_ != NULL) munmap(const_cast<char*>(data_), size_);
+  if (fd_ >= 0) ::close(fd_);
+}
+
+bool LineReader::next(const char*& begin, const char*& end) {
+  // Pages of earlier windows are not needed again
+  size_t page = (size_t) sysconf(_SC_PAGESIZE);
+  size_t done = pos_ / page * page;
+  if (done > released_) {
+    madvise(const_cast<char*>(data_) + released_, done - released_, MADV_DONTNEED);
+    released_ = done;
+  }
+
+  if (pos_ >= size_) return false;
+  size_t stop_at = std::min(size_, pos_ + window_);
+  if (stop_at < size_) {
+    const char* nl = static_cast<const char*>(std::memchr(data_ + stop_at - 1, '\n', size_ - stop_at + 1));
+    stop_at = nl != NULL ? (size_t) (nl - data_) + 1 : size_;
+  }
+  begin = data_ + pos_;
+  end = data_ + stop_at;
+  pos_ = stop_at;
+  return true;
+}
+
+void LineReader::rewind() {
+  pos_ = body_;
+  released_ = 0;
+}
+#else
+LineReader::LineReader(const std::string& path, size_t window)
+  : window_(window), f_(std::fopen(path.c_str(), "rb")), body_(0), used_(0), carry_(0) {
+  if (f_ == NULL) stop("Cannot open '" + path + "'");
+  int c;
+  while ((c = std::getc(f_)) != EOF) {
+    body_++;
+    if (c == '\n') break;
+    header_ += (char) c;
+  }
+  if (!header_.empty() && header_[header_.size() - 1] == '\r') header_.resize(header_.size() - 1);
+}
+
+LineReader::~LineReader() {
+  std::fclose(f_);
+}
+
+bool LineReader::next(const char*& begin, const char*& end) {
+  // Move the partial line left from the last window to the front
+  if (carry_ > 0) std::memmove(buffer_.data(), buffer_.data() + used_, carry_);
+  used_ = 0;
+
+  for (;;) {
+    buffer_.resize(carry_ + window_);
+    size_t got = std::fread(buffer_.data() + carry_, 1, window_, f_);
+    size_t total = carry_ + got;
+    if (got < window_) {
+      // End of the file: whatever is left is the last window
+      carry_ = 0;
+      if (total == 0) return false;
+      begin = buffer_.data();
+      end = begin + total;
+      return true;
+    }
+
+    size_t k = total;
+    while (k > 0 && buffer_[k - 1] != '\n') k--;
+    if (k == 0) {
+      carry_ = total;  // a line longer than the window: read on
+      continue;
+    }
+    begin = buffer_.data();
+    end = begin + k;
+    used_ = k;
+    carry_ = total - k;
+    return true;
+  }
+}
+
+void LineReader::rewind() {
+  _fseeki64(f_, body_, SEEK_SET);
+  used_ = carry_ = 0;
+}
+#endif
+
+// Field positions of the columns the tests read, -1 where absent
+struct StreamColumns {
+  int lon, lat, species, country;
+  int last;  // no field after this one is looked at
+};
+
+static int field_index(const std::string& header, const std::string& name) {
+  if (name.empty()) return -1;
+  int field = 0;
+  size_t start = 0;
+  for (;;) {
+    size_t tab = header.find('\t', start);
+    size_t stop_at = tab == std::string::npos ? header.size() : tab;
+    if (header.compare(start, stop_at - start, name) == 0) return field;
+    if (tab == std::string::npos) return -1;
+    start = tab + 1;
+    field++;
+  }
+}
+
+// Number in [begin, end), or NA if the field is empty or not a number
+static double parse_coordinate(const char* begin, const char* end) {
+  char buffer[64];
+  size_t length = end - begin;
+  if (length == 0 || length >= sizeof(buffer)) return NA_REAL;
+  std::memcpy(buffer, begin, length);
+  buffer[length] = '\0';
+  char* parsed;
+  double value = std::strtod(buffer, &parsed);
+  return parsed == buffer + length ? value : NA_REAL;
+}
+
+// Slot of the country code in [begin, end), as CountryReference::slot()
+static int country_slot(const CountryReference& countries, const char* begin, const char* end) {
+  size_t length = end - begin;
+  if (length == 0) return -1;
+  if (length == 3) {
+    char code[4] = {begin[0], begin[1], begin[2], '\0'};
+    int letters = CountryReference::letter_slot(code);
+    if (letters >= 0) return letters;
+  }
+  auto found = countries.other_slots.find(std::string(begin, length));
+  return found != countries.other_slots.end() ? found->second : -1;
+}
+
+// The records of one window. Species point into the window; lines keep
+// their text for the "clean" output.
+struct StreamChunk {
+  std::vector<const char*> line, line_end;
+  std::vector<double> lon, lat;
+  std::vector<const char*> species;
+  std::vector<int> species_length;  // -1 if the field is empty
+  std::vector<int> country;
+
+  R_xlen_t size() const { return (R_xlen_t) line.size(); }
+
+  // Splits [begin, end) into lines, dropping line breaks and empty lines
+  void split(const char* begin, const char* end) {
+    line.clear();
+    line_end.clear();
+    const char* p = begin;
+    while (p < end) {
+      const char* nl = static_cast<const char*>(std::memchr(p, '\n', end - p));
+      const char* e = nl != NULL ? nl : end;
+      const char* stop_at = (e > p && e[-1] == '\r') ? e - 1 : e;
+      if (stop_at > p) {
+        line.push_back(p);
+        line_end.push_back(stop_at);
+      }
+      p = nl != NULL ? nl + 1 : end;
+    }
+    R_xlen_t n = size();
+    lon.resize(n);
+    lat.resize(n);
+    species.resize(n);
+    species_length.resize(n);
+    country.resize(n);
+  }
+
+  // Reads the fields of record i; only the columns in use are parsed
+  void parse(R_xlen_t i, const StreamColumns& columns, const CountryReference* countries) {
+    lon[i] = lat[i] = NA_REAL;
+    species[i] = NULL;
+    species_length[i] = -1;
+    country[i] = -1;
+
+    const char* f = line[i];
+    const char* end = line_end[i];
+    for (int field = 0; field <= columns.last; field++) {
+      const char* tab = static_cast<const char*>(std::memchr(f, '\t', end - f));
+      const char* field_end = tab != NULL ? tab : end;
+      if (field == columns.lon) {
+        lon[i] = parse_coordinate(f, field_end);
+      } else if (field == columns.lat) {
+        lat[i] = parse_coordinate(f, field_end);
+      } else if (field == columns.species && field_end > f) {
+        species[i] = f;
+        species_length[i] = (int) (field_end - f);
+      } else if (field == columns.country && countries != NULL) {
+        country[i] = country_slot(*countries, f, field_end);
+      }
+      if (tab == NULL) break;
+      f = tab + 1;
+    }
+  }
+};
+
+// Bucket of a species name: FNV-1a, its offset basis mixed with the seed so
+// that every split level spreads the names differently
+static uint32_t species_bucket(const char* name, int length, uint32_t seed) {
+  uint32_t h = 2166136261u ^ seed * 0x9e3779b9u;
+  for (int k = 0; k < length; k++) {
+    h = (h ^ (unsigned char) name[k]) * 16777619u;
+  }
+  return h % STREAM_BUCKETS;
+}
+
+// A file of spilled records: record number, coordinates and species name of
+// each. seed is that of the hash that filled it; a bucket with one species
+// only (or only missing ones) cannot be split and is tested whole.
+struct SpillBucket {
+  std::string path;
+  R_xlen_t records;
+  uint32_t seed;
+  bool single;
+};
+
+// A missing species (length -1) is written as an empty name
+static void write_spilled(StreamFile& f, uint64_t record, double lon, double lat, const char* species,
+                          int length) {
+  length = std::max(length, 0);
+  f.write(&record, sizeof(record));
+  f.write(&lon, sizeof(double));
+  f.write(&lat, sizeof(double));
+  f.write(&length, sizeof(length));
+  if (length > 0) f.write(species, length);
+}
+
+static void read_spilled(StreamFile& f, uint64_t& record, double& lon, double& lat, std::string& species) {
+  int length;
+  f.read_exactly(&record, sizeof(record));
+  f.read_exactly(&lon, sizeof(double));
+  f.read_exactly(&lat, sizeof(double));
+  f.read_exactly(&length, sizeof(length));
+  if (length < 0) {
+    stop("Corrupt spill file");
+  }
+  species.resize(length);
+  if (length > 0) f.read_exactly(&species[0], length);
+}
+
+// Splits bucket by the hash of the next seed and removes it; returns the
+// parts that received records
+static std::vector<SpillBucket> split_bucket(const SpillBucket& bucket, SpillFiles& spill) {
+  uint32_t seed = bucket.seed + 1;
+  std::vector<SpillBucket> parts(STREAM_BUCKETS);
+  std::vector<std::unique_ptr<StreamFile> > files;
+  std::vector<std::string> first(STREAM_BUCKETS);
+  for (int b = 0; b < STREAM_BUCKETS; b++) {
+    SpillBucket part = {spill.add("cc_stream_bucket"), 0, seed, true};
+    parts[b] = part;
+    files.push_back(std::unique_ptr<StreamFile>(new StreamFile(part.path, "wb", BUCKET_BUFFER)));
+  }
+
+  {
+    StreamFile in(bucket.path, "rb", BUCKET_BUFFER);
+    uint64_t record;
+    double lon, lat;
+    std::string species;
+    for (R_xlen_t k = 0; k < bucket.records; k++) {
+      read_spilled(in, record, lon, lat, species);
+      int length = (int) species.size();
+      uint32_t b = length > 0 ? species_bucket(species.data(), length, seed) : 0;
+      if (parts[b].records == 0) {
+        first[b] = species;
+      } else if (parts[b].single && species != first[b]) {
+        parts[b].single = false;
+      }
+      write_spilled(*files[b], record, lon, lat, species.data(), length);
+      parts[b].records++;
+    }
+  }
+  std::remove(bucket.path.c_str());
+
+  std::vector<SpillBucket> kept;
+  for (int b = 0; b < STREAM_BUCKETS; b++) {
+    files[b]->close();
+    if (parts[b].records > 0) {
+      kept.push_back(parts[b]);
+    } else {
+      std::remove(parts[b].path.c_str());
+    }
+  }
+  return kept;
+}
+
+// Result files, each a record number and the bits of the grouped columns for
+// every flagged record in record order, read back merged by record number
+class ResultMerge {
+public:
+  explicit ResultMerge(const std::vector<std::string>& paths) : bits_(paths.size()) {
+    for (size_t f = 0; f < paths.size(); f++) {
+      files_.push_back(std::unique_ptr<StreamFile>(new StreamFile(paths[f], "rb", BUCKET_BUFFER)));
+      advance((int) f);
+    }
+  }
+
+  bool empty() const { return heads_.empty(); }
+
+  // Record number of the next flagged record; only if !empty()
+  uint64_t top() const { return heads_.top().first; }
+
+  // Takes the next flagged record; false once every file is done
+  bool next(uint64_t& record, uint32_t& bits) {
+    if (heads_.empty()) return false;
+    int f = heads_.top().second;
+    record = heads_.top().first;
+    bits = bits_[f];
+    heads_.pop();
+    advance(f);
+    return true;
+  }
+
+private:
+  typedef std::pair<uint64_t, int> Head;  // next flagged record of a file
+  std::vector<std::unique_ptr<StreamFile> > files_;
+  std::vector<uint32_t> bits_;
+  std::priority_queue<Head, std::vector<Head>, std::greater<Head> > heads_;
+
+  void advance(int f) {
+    uint64_t record;
+    if (files_[f]->read(&record, sizeof(record)) == sizeof(record)) {
+      files_[f]->read_exactly(&bits_[f], sizeof(uint32_t));
+      heads_.push(Head(record, f));
+    }
+  }
+};
+
+//' @title Clean an occurrence file without loading it
+//' @description Runs the tests over a tab-delimited occurrence file (such as
+//'   a GBIF occurrence.txt) one window of lines at a time. Only the
+//'   coordinate, species and country columns are parsed. Per-record tests run
+//'   on each window as it is read; species-level tests ("outliers",
+//'   "duplicates", "range") run afterwards on species buckets spilled to
+//'   tmp_dir. Records with missing or impossible coordinates fail the
+//'   "validity" column instead of stopping the run.
+//'
+//'   Memory is bounded by chunk_mb, not by the file: the window read, and
+//'   the buckets tested, which are split until they fit chunk_mb. A species
+//'   is always tested whole, so a species with more records than that is
+//'   held in memory in full.
+//' @param input path of the occurrence file, with a header line
+//' @param output path of the file written: one line of flags per record for
+//'   value "flagged", or the header and lines of the clean records for "clean"
+//' @param tests character vector of tests, as for clean_coordinates_cpp
+//' @param chunk_mb size of the windows read, and memory budget of a species
+//'   bucket, in megabytes
+//' @param tmp_dir directory for the species buckets
+//' @return list with the output path, the number of records and the number
+//'   flagged by each test and overall
+// [[Rcpp::export]]
+List cc_stream_cpp(std::string input,
+                   std::string output,
+                   CharacterVector tests,
+                   std::string lon_col = "decimalLongitude",
+                   std::string lat_col = "decimalLatitude",
+                   std::string species_col = "species",
+                   std::string countries_col = "countryCode",
+                   std::string value = "flagged",
+                   double capitals_rad = 10000.0,
+                   std::string outliers_method = "quantile",
+                   double outliers_mtp = 5,
+                   double outliers_td = 1000,
+                   int outliers_size = 7,
+                   double range_rad = 0,
+                   double zeros_rad = 0.5,
+                   SEXP capitals_ref = R_NilValue,
+                   SEXP country_ref = R_NilValue,
+                   double country_buffer = 0,
+                   SEXP range_ref = R_NilValue,
+                   SEXP seas_ref = R_NilValue,
+                   double seas_buffer = 0,
+                   SEXP urban_ref = R_NilValue,
+                   double chunk_mb = 64,
+                   std::string tmp_dir = ".",
+                   bool verbose = true,
+                   int nthreads = 1) {
+
+  if (value != "clean" && value != "flagged") {
+    stop("Invalid value argument");
+  }
+  if (!(chunk_mb > 0)) {
+    stop("chunk_mb must be positive");
+  }
+  int n_columns = tests.size() + 1;  // validity first, then the tests
+  if (n_columns > 32) {
+    stop("At most 31 tests can be streamed at once");
+  }
+
+  LineReader reader(input, (size_t) (chunk_mb * 1024 * 1024));
+  StreamColumns columns;
+  columns.lon = field_index(reader.header(), lon_col);
+  columns.lat = field_index(reader.header(), lat_col);
+  columns.species = field_index(reader.header(), species_col);
+  columns.country = field_index(reader.header(), countries_col);
+  if (columns.lon < 0 || columns.lat < 0) {
+    stop("Longitude and latitude columns not found in the header of '" + input + "'");
+  }
+
+  // Step 1: set up the tests. Bit t of a record's flag word holds column t,
+  // set when the record passed.
+  std::vector<std::string> names(1, "validity");
+  std::vector<std::pair<int, RecordTest> > per_record;
+  std::vector<int> grouped;
+  std::unique_ptr<Reference> range_owned;
+  const RangeReference* range = NULL;
+  RecordTestReferences record_refs;
+  RecordTestSettings record_settings;
+  record_settings.capitals_rad = capitals_rad;
+  record_settings.zeros_rad = zeros_rad;
+  record_settings.seas_buffer = seas_buffer;
+  record_settings.country_buffer = country_buffer;
+  record_settings.capitals_ref = capitals_ref;
+  record_settings.seas_ref = seas_ref;
+  record_settings.urban_ref = urban_ref;
+  record_settings.country_ref = country_ref;
+  record_settings.country_codes = columns.country >= 0;
+
+  for (int i = 0; i < tests.size(); i++) {
+    std::string test = as<std::string>(tests[i]);
+    int column = i + 1;
+    names.push_back(test);
+
+    // Tests that flag each record on its own are shared with clean_coordinates_cpp
+    RecordTest kernel = record_test(test, record_settings, record_refs);
+    if (kernel) {
+      per_record.push_back(std::make_pair(column, kernel));
+    } else if (test == "outliers" || test == "duplicates" || (test == "range" && !Rf_isNull(range_ref))) {
+      if (columns.species < 0) {
+        stop("Test '" + test + "' needs the species column, which is not in the header of '" + input + "'");
+      }
+      if (test == "range") range = &get_reference<RangeReference>(range_ref, "range", range_owned);
+      grouped.push_back(column);
+    } else if (test == "centroids" || test == "institutions") {
+      stop("Test '" + test + "' is not available on files; use clean_coordinates_cpp()");
+    }
+    // Unknown tests and tests without reference data flag nothing
+  }
+
+  uint32_t all_passed = n_columns == 32 ? 0xffffffffu : (1u << n_columns) - 1;
+  uint32_t grouped_mask = 0;
+  for (size_t g = 0; g < grouped.size(); g++) grouped_mask |= 1u << grouped[g];
+
+  // Writes the output of one record and counts its flags
+  StreamFile out(output, "wb");
+  std::vector<double> flagged(n_columns + 1, 0.0);
+  std::string text;
+  bool clean_output = value == "clean";
+  if (clean_output) {
+    out.write(reader.header() + "\n");
+  } else {
+    for (int t = 0; t < n_columns; t++) text += names[t] + "\t";
+    out.write(text + "summary\n");
+  }
+  auto emit = [&](uint32_t word, const char* line, const char* line_end) {
+    bool passed = word == all_passed;
+    for (int t = 0; t < n_columns; t++) {
+      if (!(word >> t & 1)) flagged[t]++;
+    }
+    if (!passed) flagged[n_columns]++;
+
+    if (clean_output) {
+      if (passed) {
+        out.write(line, line_end - line);
+        out.write("\n", 1);
+      }
+    } else {
+      text.clear();
+      for (int t = 0; t < n_columns; t++) text += (word >> t & 1) ? "TRUE\t" : "FALSE\t";
+      text += passed ? "TRUE\n" : "FALSE\n";
+      out.write(text);
+    }
+  };
+
+  // Spill files: the flag word of every record, and the valid records of
+  // each species bucket
+  SpillFiles spill(tmp_dir);
+  std::unique_ptr<StreamFile> flag_file;
+  std::vector<std::unique_ptr<StreamFile> > bucket_files;
+  std::vector<SpillBucket> buckets;
+  std::string flag_path;
+  if (!grouped.empty()) {
+    flag_path = spill.add("cc_stream_flags");
+    flag_file.reset(new StreamFile(flag_path, "wb"));
+    for (int b = 0; b < STREAM_BUCKETS; b++) {
+      SpillBucket bucket = {spill.add("cc_stream_bucket"), 0, 0, false};
+      buckets.push_back(bucket);
+      bucket_files.push_back(std::unique_ptr<StreamFile>(new StreamFile(bucket.path, "wb", BUCKET_BUFFER)));
+    }
+  }
+
+  if (verbose) {
+    Rcpp::Rcout << "Streaming " << input << std::endl;
+  }
+
+  // Step 2: read the file window by window. Each chunk of records is parsed
+  // and run through the per-record tests while it is still in cache.
+  StreamChunk chunk;
+  std::vector<int> cells;
+  std::vector<uint32_t> words;
+  uint64_t n_records = 0;
+  const char* window_begin;
+  const char* window_end;
+  while (reader.next(window_begin, window_end)) {
+    chunk.split(window_begin, window_end);
+    R_xlen_t m = chunk.size();
+    cells.assign((size_t) m * n_columns, 1);
+    RecordGeometry no_geometry = {NULL, NULL, NULL, NULL};
+    Records records = {chunk.lon.data(), chunk.lat.data(), NULL, chunk.country.data(), no_geometry};
+
+    cc_parallel_for(m, nthreads, [&](R_xlen_t begin, R_xlen_t end) {
+      for (R_xlen_t i = begin; i < end; i++) {
+        chunk.parse(i, columns, record_refs.country);
+      }
+      cc_val_block(chunk.lon.data(), chunk.lat.data(), begin, end, cells.data());
+      for (size_t t = 0; t < per_record.size(); t++) {
+        per_record[t].second(records, begin, end, cells.data() + (R_xlen_t) per_record[t].first * m);
+      }
+    });
+
+    words.assign(m, 0);
+    for (int t = 0; t < n_columns; t++) {
+      const int* column = cells.data() + (R_xlen_t) t * m;
+      for (R_xlen_t i = 0; i < m; i++) {
+        if (column[i]) words[i] |= 1u << t;
+      }
+    }
+
+    if (grouped.empty()) {
+      for (R_xlen_t i = 0; i < m; i++) emit(words[i], chunk.line[i], chunk.line_end[i]);
+    } else {
+      flag_file->write(words.data(), words.size() * sizeof(uint32_t));
+      for (R_xlen_t i = 0; i < m; i++) {
+        if (!cells[i]) continue;  // invalid coordinates are left to the validity column
+        int length = chunk.species_length[i];
+        uint32_t b = length > 0 ? species_bucket(chunk.species[i], length, 0) : 0;
+        write_spilled(*bucket_files[b], n_records + i, chunk.lon[i], chunk.lat[i], chunk.species[i], length);
+        buckets[b].records++;
+      }
+    }
+    n_records += m;
+    Rcpp::checkUserInterrupt();
+  }
+
+  if (!grouped.empty()) {
+    flag_file->close();
+    for (int b = 0; b < STREAM_BUCKETS; b++) bucket_files[b]->close();
+    bucket_files.clear();
+
+    // Step 3: run the species-level tests one bucket at a time, splitting
+    // buckets over the budget first. Records flagged by any of the tests
+    // are written, in record order, as their record number and the bits of
+    // the grouped columns.
+    R_xlen_t bucket_limit = std::max((R_xlen_t) 1, (R_xlen_t) (chunk_mb * 1024 * 1024 / BUCKET_RECORD_BYTES));
+    if (verbose) {
+      Rcpp::Rcout << "Running species-level tests on species buckets" << std::endl;
+    }
+    std::vector<std::string> result_paths;
+    std::string name;
+    while (!buckets.empty()) {
+      SpillBucket bucket = buckets.back();
+      buckets.pop_back();
+      if (bucket.records == 0) {
+        std::remove(bucket.path.c_str());
+        continue;
+      }
+      if (bucket.records > bucket_limit && !bucket.single) {
+        std::vector<SpillBucket> parts = split_bucket(bucket, spill);
+        buckets.insert(buckets.end(), parts.begin(), parts.end());
+        Rcpp::checkUserInterrupt();
+        continue;
+      }
+
+      R_xlen_t m = bucket.records;
+      std::vector<uint64_t> records(m);
+      NumericVector lon(m), lat(m);
+      CharacterVector species(m);
+      {
+        StreamFile in(bucket.path, "rb", BUCKET_BUFFER);
+        for (R_xlen_t k = 0; k < m; k++) {
+          read_spilled(in, records[k], lon[k], lat[k], name);
+          if (!name.empty()) {
+            SET_STRING_ELT(species, k, Rf_mkCharLenCE(name.data(), (int) name.size(), CE_UTF8));
+          } else {
+            SET_STRING_ELT(species, k, NA_STRING);
+          }
+        }
+      }
+      std::remove(bucket.path.c_str());
+
+      SpeciesIndex species_index(species);
+      std::vector<uint32_t> bits(m, grouped_mask);
+      for (size_t g = 0; g < grouped.size(); g++) {
+        const std::string& test = names[grouped[g]];
+        LogicalVector passed;
+        if (test == "outliers") {
+          // cc_outl_grouped flags outliers with TRUE
+          passed = !cc_outl_grouped(CoordView(lon, lat), species_index, outliers_method, outliers_mtp, outliers_td,
+                                    outliers_size, 0, nthreads);
+        } else if (test == "duplicates") {
+          passed = cc_dupl_grouped(CoordView(lon, lat), species_index, List(), nthreads);
+        } else {
+          SpeciesRanges ranges(*range, species_index, range_rad);
+          passed = LogicalVector(m);
+          cc_iucn_grouped(lon.begin(), lat.begin(), species_index, ranges, nthreads, passed.begin());
+        }
+        for (R_xlen_t k = 0; k < m; k++) {
+          if (!passed[k]) bits[k] &= ~(1u << grouped[g]);
+        }
+      }
+
+      result_paths.push_back(spill.add("cc_stream_result"));
+      StreamFile result(result_paths.back(), "wb", BUCKET_BUFFER);
+      for (R_xlen_t k = 0; k < m; k++) {
+        if (bits[k] == grouped_mask) continue;
+        result.write(&records[k], sizeof(uint64_t));
+        result.write(&bits[k], sizeof(uint32_t));
+      }
+      result.close();
+      Rcpp::checkUserInterrupt();
+    }
+
+    // Step 4: merge the bucket results into the flag words in record order
+    // and write the output, reading the file again for "clean". Results of
+    // more buckets than can be open at once are merged in rounds first.
+    while (result_paths.size() > (size_t) STREAM_BUCKETS) {
+      std::vector<std::string> merged;
+      for (size_t first = 0; first < result_paths.size(); first += STREAM_BUCKETS) {
+        size_t last = std::min(result_paths.size(), first + STREAM_BUCKETS);
+        std::vector<std::string> group(result_paths.begin() + first, result_paths.begin() + last);
+        merged.push_back(spill.add("cc_stream_result"));
+        {
+          ResultMerge merge(group);
+          StreamFile to(merged.back(), "wb", BUCKET_BUFFER);
+          uint64_t record;
+          uint32_t bits;
+          while (merge.next(record, bits)) {
+            to.write(&record, sizeof(record));
+            to.write(&bits, sizeof(bits));
+          }
+          to.close();
+        }
+        for (size_t k = 0; k < group.size(); k++) std::remove(group[k].c_str());
+      }
+      result_paths.swap(merged);
+    }
+
+    StreamFile flags_in(flag_path, "rb");
+    ResultMerge results(result_paths);
+
+    std::vector<uint32_t> block;
+    size_t block_pos = 0;
+    uint64_t record = 0;
+    auto next_word = [&]() -> uint32_t {
+      if (block_pos == block.size()) {
+        block.resize(FLAG_BLOCK);
+        block.resize(flags_in.read(block.data(), FLAG_BLOCK * sizeof(uint32_t)) / sizeof(uint32_t));
+        block_pos = 0;
+        if (block.empty()) stop("Unexpected end of the spilled flags");
+      }
+      uint32_t word = block[block_pos++];
+      uint64_t flagged_record;
+      uint32_t bits;
+      while (!results.empty() && results.top() == record && results.next(flagged_record, bits)) {
+        word = (word & ~grouped_mask) | bits;
+      }
+      record++;
+      return word;
+    };
+
+    if (clean_output) {
+      reader.rewind();
+      while (reader.next(window_begin, window_end)) {
+        chunk.split(window_begin, window_end);
+        for (R_xlen_t i = 0; i < chunk.size(); i++) {
+          emit(next_word(), chunk.line[i], chunk.line_end[i]);
+        }
+        Rcpp::checkUserInterrupt();
+      }
+    } else {
+      for (uint64_t i = 0; i < n_records; i++) {
+        emit(next_word(), NULL, NULL);
+      }
+    }
+  }
+  out.close();
+
+  if (verbose) {
+    Rcpp::Rcout << "Flagged " << (R_xlen_t) flagged[n_columns] << " of " << n_records << " records." << std::endl;
+  }
+
+  NumericVector counts(flagged.begin(), flagged.end());
+  names.push_back("summary");
+  counts.attr("names") = wrap(names);
+  return List::create(
+    Named("output") = output,
+    Named("records") = (double) n_records,
+    Named("flagged") = counts
+  );
+}
@@ -0,0 +1,18 @@
+#ifndef CC_STREAM_H
+#define CC_STREAM_H
+
+#include <Rcpp.h>
+using namespace Rcpp;
+
+List cc_stream_cpp(std::string input, std::string output, CharacterVector tests,
+                   std::string lon_col = "decimalLongitude", std::string lat_col = "decimalLatitude",
+                   std::string species_col = "species", std::string countries_col = "countryCode",
+                   std::string value = "flagged", double capitals_rad = 10000.0,
+                   std::string outliers_method = "quantile", double outliers_mtp = 5,
+                   double outliers_td = 1000, int outliers_size = 7, double range_rad = 0,
+                   double zeros_rad = 0.5, SEXP capitals_ref = R_NilValue, SEXP country_ref = R_NilValue,
+                   double country_buffer = 0, SEXP range_ref = R_NilValue, SEXP seas_ref = R_NilValue,
+                   double seas_buffer = 0, SEXP urban_ref = R_NilValue, double chunk_mb = 64,
+                   std::string tmp_dir = ".", bool verbose = true, int nthreads = 1);
+
+#endif  // CC_STREAM_H
@@ -0,0 +1,69 @@
+#include <Rcpp.h>
+#include <string>
+
+#include "cc_cap.h"
+#include "cc_coun.h"
+#include "cc_equ.h"
+#include "cc_gbif.h"
+#include "cc_sea.h"
+#include "cc_tests.h"
+#include "cc_urb.h"
+#include "cc_zero.h"
+using namespace Rcpp;
+
+// The GBIF headquarters test: records within 100 km of 0/0
+const double GBIF_LON = 0.0;
+const double GBIF_LAT = 0.0;
+const double GBIF_RADIUS = 100000;
+
+RecordTest record_test(const std::string& test, const RecordTestSettings& settings,
+                       RecordTestReferences& refs, bool* geometry) {
+  bool reads_geometry = false;
+  RecordTest kernel;
+
+  if (test == "equal") {
+    kernel = [](const Records& r, R_xlen_t begin, R_xlen_t end, int* out) {
+      cc_equ_block(r.lon, r.lat, true, begin, end, out);
+    };
+  } else if (test == "zeros") {
+    double zeros_rad = settings.zeros_rad;
+    kernel = [=](const Records& r, R_xlen_t begin, R_xlen_t end, int* out) {
+      cc_zero_block(r.lon, r.lat, zeros_rad, begin, end, out);
+    };
+  } else if (test == "capitals" && !Rf_isNull(settings.capitals_ref)) {
+    const PointIndex* index = &get_reference<PointReference>(settings.capitals_ref, "capitals", refs.capitals).index;
+    double capitals_rad = settings.capitals_rad;
+    reads_geometry = true;
+    kernel = [=](const Records& r, R_xlen_t begin, R_xlen_t end, int* out) {
+      cc_cap_block(r.lon, r.lat, capitals_rad, true, *index, begin, end, out, r.geometry());
+    };
+  } else if (test == "seas" && !Rf_isNull(settings.seas_ref)) {
+    const PolygonSet* land = &get_reference<PolygonReference>(settings.seas_ref, "seas", refs.seas).polygons;
+    double seas_buffer = settings.seas_buffer;
+    reads_geometry = seas_buffer > 0;
+    kernel = [=](const Records& r, R_xlen_t begin, R_xlen_t end, int* out) {
+      cc_sea_block(r.lon, r.lat, *land, seas_buffer, begin, end, out, r.geometry());
+    };
+  } else if (test == "urban" && !Rf_isNull(settings.urban_ref)) {
+    const PolygonSet* urban = &get_reference<PolygonReference>(settings.urban_ref, "urban", refs.urban).polygons;
+    kernel = [=](const Records& r, R_xlen_t begin, R_xlen_t end, int* out) {
+      cc_urb_block(r.lon, r.lat, *urban, 0.0, begin, end, out);
+    };
+  } else if (test == "gbif") {
+    reads_geometry = true;
+    kernel = [](const Records& r, R_xlen_t begin, R_xlen_t end, int* out) {
+      cc_gbif_block(r.lon, r.lat, GBIF_LON, GBIF_LAT, GBIF_RADIUS, begin, end, out, r.geometry());
+    };
+  } else if (test == "countries" && settings.country_codes && !Rf_isNull(settings.country_ref)) {
+    refs.country = &get_reference<CountryReference>(settings.country_ref, "countries", refs.countries);
+    const CountryReference* countries = refs.country;
+    double country_buffer = settings.country_buffer;
+    reads_geometry = true;
+    kernel = [=](const Records& r, R_xlen_t begin, R_xlen_t end, int* out) {
+      cc_coun_block(r.lon, r.lat, r.country, *countries, country_buffer, begin, end, out, r.geometry());
+    };
+  }
+
+  if (geometry != NULL && kernel && reads_geometry) *geometry = true;
+  return kernel;
+}
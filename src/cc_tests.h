@@ -0,0 +1,58 @@
+#ifndef CC_TESTS_H
+#define CC_TESTS_H
+
+#include <Rcpp.h>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "cc_coords.h"
+#include "cc_reference.h"
+using namespace Rcpp;
+
+// Coordinate columns of the records a test runs on; species holds species
+// ids, country the country slots and geo the geometry of the run's cache,
+// each only filled in when a test needs it
+struct Records {
+  const double* lon;
+  const double* lat;
+  const int* species;
+  const int* country;
+  RecordGeometry geo;
+
+  const RecordGeometry* geometry() const { return geo.ux ? &geo : NULL; }
+};
+
+// Writes the flags of records [begin, end) to out
+typedef std::function<void(const Records&, R_xlen_t, R_xlen_t, int*)> RecordTest;
+
+// Settings and reference data of the tests that flag each record on its
+// own; the references are R objects or cc_build_reference() handles, and
+// country_codes tells whether the records come with country slots
+struct RecordTestSettings {
+  double capitals_rad;
+  double zeros_rad;
+  double seas_buffer;
+  double country_buffer;
+  SEXP capitals_ref;
+  SEXP seas_ref;
+  SEXP urban_ref;
+  SEXP country_ref;
+  bool country_codes;
+};
+
+// References the record tests of a run were built from, kept alive as long
+// as the tests are
+struct RecordTestReferences {
+  std::unique_ptr<Reference> capitals, seas, urban, countries;
+  const CountryReference* country = NULL;  // set once the countries test is built
+};
+
+// The kernel of a per-record test ("equal", "zeros", "capitals", "seas",
+// "urban", "gbif" or "countries"), or an empty function for any other test
+// and for tests without their reference data. Sets *geometry if the kernel
+// reads Records::geo.
+RecordTest record_test(const std::string& test, const RecordTestSettings& settings,
+                       RecordTestReferences& refs, bool* geometry = NULL);
+
+#endif  // CC_TESTS_H
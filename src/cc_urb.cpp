@@ -1,47 +1,36 @@
 #include <Rcpp.h>
+#include "cc_coords.h"
+#include "cc_parallel.h"
+#include "cc_reference.h"
 using namespace Rcpp;
 
-// Static function for point-in-polygon test using ray-casting
-static bool isPointInPolygon(double x, double y, NumericMatrix polygon) {
-  int nvert = polygon.nrow();
-  bool inside = false;
-
-  for (int i = 0, j = nvert - 1; i < nvert; j = i++) {
-    double xi = polygon(i, 0), yi = polygon(i, 1);
-    double xj = polygon(j, 0), yj = polygon(j, 1);
-
-    if (((yi > y) != (yj > y)) &&
-        (x < (xj - xi) * (y - yi) / (yj - yi) + xi)) {
-      inside = !inside;
-    }
+void cc_urb_block(const double* lon, const double* lat, const PolygonSet& polygons, double buffer,
+                  R_xlen_t begin, R_xlen_t end, int* out) {
+  for (R_xlen_t i = begin; i < end; i++) {
+    // Points within buffer meters of an urban area count as urban
+    bool is_urban = polygons.within_distance(lon[i], lat[i], buffer);
+    out[i] = is_urban;
   }
-  return inside;
 }
 
+// coords is a data.frame with columns lon_col and lat_col, or a matrix with
+// longitude and latitude columns; either is read in place
 // [[Rcpp::export]]
-LogicalVector cc_urb_cpp(NumericMatrix coords, List urban_polygons,
-                         double buffer = 0) {
-  int n_points = coords.nrow();
+LogicalVector cc_urb_cpp(SEXP coords, SEXP urban_polygons, double buffer = 0, int nthreads = 1,
+                        std::string lon_col = "decimalLongitude", std::string lat_col = "decimalLatitude") {
+  CoordView view(coords, lon_col, lat_col);
+  R_xlen_t n_points = view.size();
   LogicalVector result(n_points);
+  std::unique_ptr<Reference> owned;
+  const PolygonSet& polygons = get_reference<PolygonReference>(urban_polygons, "urban", owned).polygons;
 
-  // Iterate over all points
-  for (int i = 0; i < n_points; i++) {
-    double lon = coords(i, 0);
-    double lat = coords(i, 1);
-    bool is_urban = false;
+  const double* x = view.lon();
+  const double* y = view.lat();
+  int* out = result.begin();
 
-    // Check if the point is inside any urban polygon
-    for (int j = 0; j < urban_polygons.size(); j++) {
-      NumericMatrix polygon = urban_polygons[j];
-
-      // Apply buffer if necessary (currently omitted for simplicity)
-      if (isPointInPolygon(lon, lat, polygon)) {
-        is_urban = true;
-        break;
-      }
-    }
-    result[i] = is_urban;
-  }
+  cc_parallel_for(n_points, nthreads, [&](R_xlen_t begin, R_xlen_t end) {
+    cc_urb_block(x, y, polygons, buffer, begin, end, out);
+  });
 
   return result;
 }
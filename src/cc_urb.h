@@ -2,8 +2,14 @@
 #define CC_URB_H
 
 #include <Rcpp.h>
+#include "cc_poly.h"
 using namespace Rcpp;
 
-LogicalVector cc_urb_cpp(NumericMatrix coords, List urban_polygons, double buffer = 0);
+LogicalVector cc_urb_cpp(SEXP coords, SEXP urban_polygons, double buffer = 0, int nthreads = 1,
+                        std::string lon_col = "decimalLongitude", std::string lat_col = "decimalLatitude");
+
+// Writes the flags of records [begin, end) to out
+void cc_urb_block(const double* lon, const double* lat, const PolygonSet& polygons, double buffer,
+                  R_xlen_t begin, R_xlen_t end, int* out);
 
 #endif  // CC_URB_H
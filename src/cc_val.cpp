@@ -1,17 +1,25 @@
 #include <Rcpp.h>
+#include "cc_parallel.h"
 using namespace Rcpp;
 
+void cc_val_block(const double* lon, const double* lat, R_xlen_t begin, R_xlen_t end, int* out) {
+  for (R_xlen_t i = begin; i < end; ++i) {
+    out[i] = !(NumericVector::is_na(lon[i]) || NumericVector::is_na(lat[i]) ||
+               lon[i] < -180 || lon[i] > 180 || lat[i] < -90 || lat[i] > 90);
+  }
+}
+
 // [[Rcpp::export]]
-LogicalVector cc_val_cpp(NumericVector lon, NumericVector lat) {
+LogicalVector cc_val_cpp(NumericVector lon, NumericVector lat, int nthreads = 1) {
   int n = lon.size();
   LogicalVector result(n, true);
+  const double* x = lon.begin();
+  const double* y = lat.begin();
+  int* out = result.begin();
 
-  for (int i = 0; i < n; ++i) {
-    if (NumericVector::is_na(lon[i]) || NumericVector::is_na(lat[i]) ||
-        lon[i] < -180 || lon[i] > 180 || lat[i] < -90 || lat[i] > 90) {
-      result[i] = false;
-    }
-  }
+  cc_parallel_for(n, nthreads, [&](R_xlen_t begin, R_xlen_t end) {
+    cc_val_block(x, y, begin, end, out);
+  });
 
   return result;
 }
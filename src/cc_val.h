@@ -0,0 +1,12 @@
+#ifndef CC_VAL_H
+#define CC_VAL_H
+
+#include <Rcpp.h>
+using namespace Rcpp;
+
+LogicalVector cc_val_cpp(NumericVector lon, NumericVector lat, int nthreads = 1);
+
+// Writes the flags of records [begin, end) to out
+void cc_val_block(const double* lon, const double* lat, R_xlen_t begin, R_xlen_t end, int* out);
+
+#endif  // CC_VAL_H
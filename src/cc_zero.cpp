@@ -1,17 +1,26 @@
 #include <Rcpp.h>
+#include "cc_parallel.h"
 using namespace Rcpp;
 
+void cc_zero_block(const double* lon, const double* lat, double buffer,
+                   R_xlen_t begin, R_xlen_t end, int* out) {
+  double buffer_squared = buffer * buffer;
+  for (R_xlen_t i = begin; i < end; ++i) {
+    out[i] = !(lon[i] == 0 || lat[i] == 0 || (lon[i] * lon[i] + lat[i] * lat[i] <= buffer_squared));
+  }
+}
+
 // [[Rcpp::export]]
-LogicalVector cc_zero_cpp(NumericVector lon, NumericVector lat, double buffer) {
+LogicalVector cc_zero_cpp(NumericVector lon, NumericVector lat, double buffer, int nthreads = 1) {
   int n = lon.size();
   LogicalVector result(n, true);
-  double buffer_squared = buffer * buffer;
+  const double* x = lon.begin();
+  const double* y = lat.begin();
+  int* out = result.begin();
 
-  for (int i = 0; i < n; ++i) {
-    if (lon[i] == 0 || lat[i] == 0 || (lon[i] * lon[i] + lat[i] * lat[i] <= buffer_squared)) {
-      result[i] = false;
-    }
-  }
+  cc_parallel_for(n, nthreads, [&](R_xlen_t begin, R_xlen_t end) {
+    cc_zero_block(x, y, buffer, begin, end, out);
+  });
 
   return result;
 }
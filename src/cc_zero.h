@@ -4,6 +4,10 @@
 #include <Rcpp.h>
 using namespace Rcpp;
 
-LogicalVector cc_zero_cpp(NumericVector lon, NumericVector lat, double buffer);
+LogicalVector cc_zero_cpp(NumericVector lon, NumericVector lat, double buffer, int nthreads = 1);
+
+// Writes the flags of records [begin, end) to out
+void cc_zero_block(const double* lon, const double* lat, double buffer,
+                   R_xlen_t begin, R_xlen_t end, int* out);
 
 #endif  // CC_ZERO_H
@@ -1,23 +1,114 @@
 // [[Rcpp::plugins(cpp11)]]
 #include <Rcpp.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <vector>
 
 // include necessary headers for the "cc_" prefixed functions
 #include "cc_val.h"
-#include "cc_equ.h"
-#include "cc_zero.h"
-#include "cc_cap.h"
 #include "cc_cen.h"
-#include "cc_sea.h"
-#include "cc_urb.h"
-#include "cc_coun.h"
+#include "cc_coords.h"
 #include "cc_outl.h"
-#include "cc_gbif.h"
 #include "cc_inst.h"
 #include "cc_iucn.h"
 #include "cc_dupl.h"
+#include "cc_flags.h"
+#include "cc_parallel.h"
+#include "cc_reference.h"
+#include "cc_species.h"
+#include "cc_tests.h"
 
 using namespace Rcpp;
 
+// One requested test. Tests that flag each record on its own set
+// per_record, which writes the flags of records [begin, end) to out. The
+// others need whole species groups or the full data set and set whole_data,
+// which flags the rows of the data frame it is given, along with their
+// interned species and their Records.
+struct CleaningTest {
+  std::string name;
+  int column;
+  double rank;       // tests run in increasing rank when ordered
+  double cost;       // planner estimates: seconds per record
+  double pass_rate;  // and share of records left clean
+  RecordTest per_record;
+  std::function<LogicalVector(DataFrame, const SpeciesIndex&, const Records&)> whole_data;
+  bool uses_records;   // reads its Records (all per-record tests do)
+  bool uses_geometry;  // and their geometry
+};
+
+// Records the planner runs each test on
+const int PLAN_SAMPLE_SIZE = 1000;
+
+// Rough rank of a test's cost per record, cheapest first
+static int test_cost(const std::string& test) {
+  static const char* order[] = {"equal", "zeros", "gbif", "capitals", "range", "countries",
+                                "duplicates", "urban", "seas", "centroids", "institutions",
+                                "outliers"};
+  int n_order = sizeof(order) / sizeof(order[0]);
+  for (int i = 0; i < n_order; i++) {
+    if (test == order[i]) return i;
+  }
+  return n_order;
+}
+
+// The records from offset on, so a kernel writes the flags of a chunk
+// starting at out[0]
+static Records shift(const Records& r, R_xlen_t offset) {
+  Records shifted = {r.lon + offset, r.lat + offset, r.species ? r.species + offset : NULL,
+                     r.country ? r.country + offset : NULL, r.geo.ux ? r.geo.from(offset) : r.geo};
+  return shifted;
+}
+
+// The flags as returned to R: unpacked into a records x tests matrix with
+// the summary, or packed along with the row numbers of the clean records;
+// with the plan the tests ran by, if any
+static List flag_results(const FlagSet& flags, const std::string& output, SEXP plan = R_NilValue) {
+  std::vector<uint64_t> passed = flags.summary();
+  bool packed = output == "packed";
+  RObject results = packed ? flags.object() : (SEXP) flags.matrix();
+  RObject clean = packed ? (SEXP) flag_rows(passed.data(), flags.size())
+                         : (SEXP) unpack_words(passed.data(), flags.size());
+  const char* clean_name = packed ? "clean" : "summary";
+  if (Rf_isNull(plan)) {
+    return List::create(Named("results") = results, Named(clean_name) = clean);
+  }
+  return List::create(Named("results") = results, Named(clean_name) = clean, Named("plan") = plan);
+}
+
+template <int RTYPE>
+static SEXP gather_vector(SEXP column, const std::vector<int>& rows) {
+  Vector<RTYPE> from(column);
+  Vector<RTYPE> to(rows.size());
+  for (size_t k = 0; k < rows.size(); k++) {
+    to[k] = from[rows[k]];
+  }
+  Rf_copyMostAttrib(from, to);  // keeps factor levels
+  return to;
+}
+
+// Data frame holding the given rows of the named columns of x
+static DataFrame gather_rows(DataFrame x, const std::vector<std::string>& columns,
+                             const std::vector<int>& rows) {
+  List out(columns.size());
+  for (size_t c = 0; c < columns.size(); c++) {
+    SEXP column = x[columns[c]];
+    switch (TYPEOF(column)) {
+      case REALSXP: out[c] = gather_vector<REALSXP>(column, rows); break;
+      case INTSXP:  out[c] = gather_vector<INTSXP>(column, rows); break;
+      case LGLSXP:  out[c] = gather_vector<LGLSXP>(column, rows); break;
+      case STRSXP:  out[c] = gather_vector<STRSXP>(column, rows); break;
+      default: stop("Unsupported type of column '" + columns[c] + "'");
+    }
+  }
+  out.attr("names") = wrap(columns);
+  out.attr("class") = "data.frame";
+  out.attr("row.names") = IntegerVector::create(NA_INTEGER, -(int) rows.size());
+  return DataFrame(out);
+}
+
 // [[Rcpp::export]]
 List clean_coordinates_cpp(DataFrame x,
                            CharacterVector tests,
@@ -35,114 +126,396 @@ List clean_coordinates_cpp(DataFrame x,
                            int outliers_size = 7,
                            double range_rad = 0,
                            double zeros_rad = 0.5,
-                           Nullable<DataFrame> capitals_ref = R_NilValue,
-                           Nullable<DataFrame> centroids_ref = R_NilValue,
-                           Nullable<DataFrame> country_ref = R_NilValue,
-                           String country_refcol = "iso_a3",
+                           SEXP capitals_ref = R_NilValue,
+                           SEXP centroids_ref = R_NilValue,
+                           SEXP country_ref = R_NilValue,
                            Nullable<NumericVector> country_buffer = R_NilValue,
-                           Nullable<DataFrame> inst_ref = R_NilValue,
-                           Nullable<DataFrame> range_ref = R_NilValue,
-                           Nullable<DataFrame> seas_ref = R_NilValue,
+                           SEXP inst_ref = R_NilValue,
+                           SEXP range_ref = R_NilValue,
+                           SEXP seas_ref = R_NilValue,
                            double seas_scale = 50,
                            Nullable<NumericVector> seas_buffer = R_NilValue,
-                           Nullable<DataFrame> urban_ref = R_NilValue,
+                           SEXP urban_ref = R_NilValue,
                            double aohi_rad = 1000,
-                           bool verbose = true) {
+                           bool verbose = true,
+                           int nthreads = 1,
+                           bool fused = true,
+                           bool short_circuit = false,
+                           bool plan = false,
+                           std::string output = "logical") {
+
+  if (output != "logical" && output != "packed") {
+    stop("Invalid output argument");
+  }
 
-  // Extract coordinates and species columns from the data
-  NumericVector lon = x[lon_col];
-  NumericVector lat = x[lat_col];
+  // Coordinates are read in place; species column from the data
+  CoordView coords(x, lon_col, lat_col);
   CharacterVector species = x[species_col];
-  int n = lon.size();
+  int n = coords.size();
 
-  // Initialize results matrix and summary vector
-  LogicalMatrix results(n, tests.size());
-  LogicalVector summary(n, true);
+  // One bit per record and test, all set until a test flags the record;
+  // the summary is their AND
+  FlagSet flags(n, tests);
 
-  // Step 1: Validate coordinates
-  results(_, 0) = cc_val_cpp(lon, lat);
+  // Optional reference data: raw R objects or cc_build_reference() handles
+  bool cen_ref_provided = !Rf_isNull(centroids_ref);
 
-  // Stop if there are invalid coordinates
-  if (is_true(any(!results(_, 0)))) {
-    stop("Invalid coordinates detected. Please clean dataset before proceeding.");
+  // Species are interned once and shared by every species-aware test
+  bool needs_species = false;
+  for (int i = 0; i < tests.size(); i++) {
+    std::string test = Rcpp::as<std::string>(tests[i]);
+    if (test == "range" || test == "outliers" || test == "institutions" || test == "duplicates") {
+      needs_species = true;
+    }
   }
+  SpeciesIndex species_index;
+  if (needs_species) species_index = SpeciesIndex(species);
 
-  // Prepare optional reference data if provided
-  NumericMatrix cap_ref, cen_ref;
-  bool cap_ref_provided = !Rf_isNull(capitals_ref);
-  bool cen_ref_provided = !Rf_isNull(centroids_ref);
-  if (cap_ref_provided) cap_ref = as<NumericMatrix>(capitals_ref);
-  if (cen_ref_provided) cen_ref = as<NumericMatrix>(centroids_ref);
-
-  // Prepare country reference data if provided
-  DataFrame coun_ref;
-  bool coun_ref_provided = !Rf_isNull(country_ref);
-  if (coun_ref_provided) coun_ref = country_ref.get();
+  // Step 1: set up the requested tests
+  std::vector<CleaningTest> steps;
+  std::unique_ptr<Reference> cen_owned, range_owned, inst_owned;
+  RecordTestReferences record_refs;
+  RecordTestSettings record_settings;
+  record_settings.capitals_rad = capitals_rad;
+  record_settings.zeros_rad = zeros_rad;
+  record_settings.seas_buffer = seas_buffer.isNotNull() ? as<NumericVector>(seas_buffer)[0] : 0.0;
+  record_settings.country_buffer = country_buffer.isNotNull() ? as<NumericVector>(country_buffer)[0] : 0.0;
+  record_settings.capitals_ref = capitals_ref;
+  record_settings.seas_ref = seas_ref;
+  record_settings.urban_ref = urban_ref;
+  record_settings.country_ref = country_ref;
+  record_settings.country_codes = countries_col.isNotNull();
+  std::vector<int> country_slots;
+  bool needs_geometry = false;  // some distance test reads the geometry cache
+  std::unique_ptr<SpeciesRanges> range_lookup;
+  bool test_verbose = verbose;  // the planner runs the tests quietly
 
-  // Sequential test execution
   for (int i = 0; i < tests.size(); i++) {
-    std::string test = Rcpp::as<std::string>(tests[i]);
+    CleaningTest step;
+    step.name = Rcpp::as<std::string>(tests[i]);
+    step.column = i;
+    step.rank = test_cost(step.name);
+    step.cost = NA_REAL;
+    step.pass_rate = NA_REAL;
+    step.uses_records = false;
+    step.uses_geometry = false;
+    const std::string& test = step.name;
 
-    if (test == "equal") {
-      results(_, i) = cc_equ_cpp(lon, lat, "test");
-    } else if (test == "zeros") {
-      results(_, i) = cc_zero_cpp(lon, lat, zeros_rad);
-    } else if (test == "capitals" && cap_ref_provided) {
-      NumericMatrix points(n, 2);
-      for (int j = 0; j < n; j++) {
-        points(j, 0) = lon[j];
-        points(j, 1) = lat[j];
+    // Tests that flag each record on its own are shared with cc_stream_cpp
+    step.per_record = record_test(test, record_settings, record_refs, &step.uses_geometry);
+    if (step.per_record) {
+      step.uses_records = true;
+      if (test == "countries") {
+        CharacterVector codes = x[as<std::string>(countries_col.get())];
+        const SEXP* code = STRING_PTR_RO(codes);
+        country_slots.resize(n);
+        for (int k = 0; k < n; k++) {
+          country_slots[k] = record_refs.country->slot(code[k]);
+        }
+      }
+    } else if (test == "range" && !Rf_isNull(range_ref)) {
+      const RangeReference* range = &get_reference<RangeReference>(range_ref, "range", range_owned);
+      range_lookup.reset(new SpeciesRanges(*range, species_index, range_rad));
+      const SpeciesRanges* lookup = range_lookup.get();
+      step.uses_records = true;
+      if (lookup->has_polygons) {
+        // Polygon ranges are tested species by species
+        step.whole_data = [&, lookup](DataFrame data, const SpeciesIndex& data_species,
+                                      const Records& r) -> LogicalVector {
+          LogicalVector in_range(data.nrows());
+          cc_iucn_grouped(r.lon, r.lat, data_species, *lookup, nthreads, in_range.begin());
+          return in_range;
+        };
+      } else {
+        step.per_record = [=](const Records& r, R_xlen_t begin, R_xlen_t end, int* out) {
+          cc_iucn_block(r.lon, r.lat, r.species, *lookup, begin, end, out);
+        };
       }
-      results(_, i) = cc_cap_cpp(points, capitals_rad, true, cap_ref);
     } else if (test == "centroids" && cen_ref_provided) {
-      results(_, i) = cc_cen_cpp(x, lon_col, lat_col, species_col, centroids_rad, true, centroids_detail, cen_ref, true, "clean", verbose);
-    } else if (test == "seas" && !Rf_isNull(seas_ref)) {
-      NumericMatrix coords(n, 2);
-      for (int j = 0; j < n; j++) {
-        coords(j, 0) = lon[j];
-        coords(j, 1) = lat[j];
+      std::string detail = centroids_detail;
+      if (detail != "both" && detail != "country" && detail != "provinces") {
+        stop("Invalid test argument");
       }
-      results(_, i) = cc_sea_cpp(coords, as<List>(seas_ref), seas_scale);
-    } else if (test == "urban" && !Rf_isNull(urban_ref)) {
-      NumericMatrix coords(n, 2);
-      for (int j = 0; j < n; j++) {
-        coords(j, 0) = lon[j];
-        coords(j, 1) = lat[j];
+      if (centroids_rad < 100) {
+        warning("Using small buffer, check 'geod'");
       }
-      results(_, i) = cc_urb_cpp(coords, as<List>(urban_ref), 0.0);
-    } else if (test == "countries" && countries_col.isNotNull() && coun_ref_provided) {
-      CharacterVector countries = x[Rcpp::as<std::string>(countries_col.get())];
-      results(_, i) = as<LogicalVector>(cc_coun_cpp(x, lon_col, lat_col, country_refcol));
+      const PointIndex* index =
+        &get_reference<CentroidReference>(centroids_ref, "centroids", cen_owned).select(detail);
+      step.uses_records = true;
+      step.uses_geometry = true;
+      step.whole_data = [&, index](DataFrame data, const SpeciesIndex&, const Records& r) -> LogicalVector {
+        if (test_verbose) {
+          Rcpp::Rcout << "Testing country centroids" << std::endl;
+        }
+        // Geodesic, with records sharing their coordinates kept
+        LogicalVector is_clean(data.nrows(), true);
+        cc_cen_flags(r.lon, r.lat, is_clean.size(), *index, centroids_rad, true, true, nthreads,
+                     is_clean.begin(), r.geometry());
+        return is_clean;
+      };
     } else if (test == "outliers") {
-      results(_, i) = cc_outl_cpp(lon, lat, outliers_method, outliers_mtp, outliers_td, outliers_size, false);
-    } else if (test == "gbif") {
-      results(_, i) = cc_gbif_cpp(x, lon_col, lat_col);
+      step.whole_data = [&](DataFrame data, const SpeciesIndex& data_species, const Records&) -> LogicalVector {
+        // cc_outl_grouped flags outliers with TRUE
+        LogicalVector outliers = cc_outl_grouped(CoordView(data, lon_col, lat_col), data_species,
+                                                 outliers_method, outliers_mtp, outliers_td, outliers_size,
+                                                 0, nthreads);
+        return !outliers;
+      };
     } else if (test == "institutions" && !Rf_isNull(inst_ref)) {
-      DataFrame inst_df = as<DataFrame>(inst_ref.get());
-      NumericVector inst_lon = inst_df["lon"];  // Adjusted for proper access
-      NumericVector inst_lat = inst_df["lat"];
-      results(_, i) = as<LogicalVector>(cc_inst_cpp(x, inst_lon, inst_lat, lon_col, lat_col, species_col, inst_rad));
-    } else if (test == "range" && !Rf_isNull(range_ref)) {
-      results(_, i) = as<LogicalVector>(cc_iucn_cpp(x, as<List>(range_ref), lon_col, lat_col, species_col, range_rad));
+      const PointIndex* index = &get_reference<PointReference>(inst_ref, "institutions", inst_owned).index;
+      step.whole_data = [&, index](DataFrame data, const SpeciesIndex& data_species,
+                                   const Records&) -> LogicalVector {
+        return cc_inst_flags(CoordView(data, lon_col, lat_col), data_species, *index, inst_rad,
+                             false, false, 10, nthreads);
+      };
     } else if (test == "duplicates") {
-      List additions;
-      results(_, i) = cc_dupl_cpp(lon, lat, species, additions);
+      step.whole_data = [&](DataFrame data, const SpeciesIndex& data_species, const Records&) -> LogicalVector {
+        List additions;
+        return cc_dupl_grouped(CoordView(data, lon_col, lat_col), data_species, additions, nthreads);
+      };
+    } else {
+      // Unknown test or missing reference data: nothing is flagged
+      continue;
     }
+    needs_geometry = needs_geometry || step.uses_geometry;
+    steps.push_back(step);
   }
 
-  // Create a summary
-  for (int i = 0; i < n; i++) {
-    for (int j = 0; j < results.ncol(); j++) {
-      if (!results(i, j)) {
-        summary[i] = false;
-        break;
+  // Unit vectors and cos of the latitude of every record, worked out once
+  // for all the distance tests of the run
+  GeoCache geo_cache;
+  if (needs_geometry) geo_cache = GeoCache(coords.lon(), coords.lat(), n, nthreads);
+  RecordGeometry no_geometry = {NULL, NULL, NULL, NULL};
+
+  Records all = {coords.lon(), coords.lat(), needs_species ? species_index.ids() : NULL,
+                 country_slots.empty() ? NULL : country_slots.data(),
+                 geo_cache.empty() ? no_geometry : geo_cache.view()};
+
+  // Columns handed to the whole-data tests when they run on part of the data
+  std::vector<std::string> columns;
+  std::string extra[] = {lon_col, lat_col, species_col,
+                         countries_col.isNotNull() ? as<std::string>(countries_col.get()) : std::string()};
+  for (int c = 0; c < 4; c++) {
+    if (x.containsElementNamed(extra[c].c_str()) &&
+        std::find(columns.begin(), columns.end(), extra[c]) == columns.end()) {
+      columns.push_back(extra[c]);
+    }
+  }
+
+  // Runs step on the given rows only and writes their flags, in the same
+  // order, to out
+  std::vector<double> sub_lon, sub_lat;
+  std::vector<int> sub_species, sub_country;
+  GeoCache sub_geo;
+  auto run_rows = [&](const CleaningTest& step, const std::vector<int>& rows, int threads,
+                      std::vector<int>& out) {
+    int m = (int) rows.size();
+    out.resize(m);
+
+    // Compact the records so the kernels run on contiguous data. Whole-data
+    // tests that read the data frame instead get no Records, and only the
+    // tests that measure distances get the geometry.
+    Records subset = {NULL, NULL, NULL, NULL, no_geometry};
+    if (step.uses_records) {
+      sub_lon.resize(m);
+      sub_lat.resize(m);
+      if (all.species) sub_species.resize(m);
+      if (all.country) sub_country.resize(m);
+      for (int k = 0; k < m; k++) {
+        sub_lon[k] = all.lon[rows[k]];
+        sub_lat[k] = all.lat[rows[k]];
+        if (all.species) sub_species[k] = all.species[rows[k]];
+        if (all.country) sub_country[k] = all.country[rows[k]];
       }
+      subset.lon = sub_lon.data();
+      subset.lat = sub_lat.data();
+      subset.species = all.species ? sub_species.data() : NULL;
+      subset.country = all.country ? sub_country.data() : NULL;
+    }
+    if (step.uses_geometry) {
+      sub_geo = GeoCache(geo_cache, rows);
+      subset.geo = sub_geo.view();
     }
+
+    if (step.per_record) {
+      cc_parallel_for(m, threads, [&](R_xlen_t begin, R_xlen_t end) {
+        step.per_record(subset, begin, end, out.data());
+      });
+    } else {
+      SpeciesIndex species_rows = needs_species ? SpeciesIndex(species_index, rows) : SpeciesIndex();
+      LogicalVector flagged = step.whole_data(gather_rows(x, columns, rows), species_rows, subset);
+      if (flagged.size() != m) {
+        stop("Test '" + step.name + "' returned the wrong number of flags");
+      }
+      std::copy(flagged.begin(), flagged.end(), out.begin());
+    }
+  };
+
+  // Runs step on all records, packing its flags into its column. Per-record
+  // tests write each chunk's flags to a buffer of the chunk's own.
+  auto run_all = [&](const CleaningTest& step) {
+    if (step.per_record) {
+      cc_parallel_for(n, nthreads, [&](R_xlen_t begin, R_xlen_t end) {
+        int chunk[CC_CHUNK_SIZE];
+        step.per_record(shift(all, begin), 0, end - begin, chunk);
+        flags.pack(step.column, chunk, begin, end);
+      });
+    } else {
+      LogicalVector flagged = step.whole_data(x, species_index, all);
+      if (flagged.size() != n) {
+        stop("Test '" + step.name + "' returned the wrong number of flags");
+      }
+      flags.pack(step.column, flagged.begin(), 0, n);
+    }
+  };
+
+  // Step 2: validate coordinates. In fused mode the per-record tests run in
+  // the same sweep, and their flags are packed while each chunk of records
+  // is still in cache. Once any chunk holds an invalid record the call will
+  // stop, so the chunks after it skip the tests.
+  bool ordered = short_circuit || plan;
+  bool sweep = fused && !ordered;
+  std::vector<int> valid(n);
+  std::atomic<bool> invalid(false);
+  cc_parallel_for(n, nthreads, [&](R_xlen_t begin, R_xlen_t end) {
+    cc_val_block(all.lon, all.lat, begin, end, valid.data());
+    if (std::find(valid.begin() + begin, valid.begin() + end, 0) != valid.begin() + end) {
+      invalid.store(true, std::memory_order_relaxed);
+    }
+    if (!sweep || invalid.load(std::memory_order_relaxed)) return;
+    Records chunk_records = shift(all, begin);
+    int chunk[CC_CHUNK_SIZE];
+    for (size_t t = 0; t < steps.size(); t++) {
+      if (!steps[t].per_record) continue;
+      steps[t].per_record(chunk_records, 0, end - begin, chunk);
+      flags.pack(steps[t].column, chunk, begin, end);
+    }
+  });
+
+  // Stop if there are invalid coordinates
+  if (invalid) {
+    stop("Invalid coordinates detected. Please clean dataset before proceeding.");
   }
 
-  // Return results and summary
-  return List::create(
-    Named("results") = results,
-    Named("summary") = summary
+  if (!ordered) {
+    // Step 3: one pass per remaining test, in the order requested
+    for (size_t t = 0; t < steps.size(); t++) {
+      const CleaningTest& step = steps[t];
+      if (step.per_record && sweep) continue;
+      run_all(step);
+    }
+
+    return flag_results(flags, output);
+  }
+
+  // Step 3 (planned): time every per-record test on a sample spread evenly
+  // over the data. Assuming tests reject independently, running them in
+  // increasing cost / (1 - pass rate) minimises the expected total time.
+  // Whole-data tests (duplicates, outliers, institutions, centroids, polygon
+  // ranges) judge a record by the rest of its species or data set, which
+  // scattered sample rows do not show, so they are not timed and run after
+  // the per-record tests.
+  std::vector<int> sample_flags;
+  if (plan && n > 0) {
+    int sample_size = std::min(n, PLAN_SAMPLE_SIZE);
+    std::vector<int> sample(sample_size);
+    for (int k = 0; k < sample_size; k++) {
+      sample[k] = (int) ((double) k * n / sample_size);
+    }
+
+    test_verbose = false;
+    for (size_t t = 0; t < steps.size(); t++) {
+      CleaningTest& step = steps[t];
+      if (!step.per_record) {
+        step.rank = R_PosInf;
+        continue;
+      }
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      run_rows(step, sample, 1, sample_flags);
+      std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+      int passed = 0;
+      for (int k = 0; k < sample_size; k++) {
+        if (sample_flags[k]) passed++;
+      }
+      step.cost = elapsed.count() / sample_size;
+      step.pass_rate = (double) passed / sample_size;
+      step.rank = step.pass_rate < 1 ? step.cost / (1 - step.pass_rate) : R_PosInf;
+    }
+    test_verbose = verbose;
+  }
+
+  // Step 4: run the tests in rank order, each seeing only the records that
+  // are still clean. The bits of records a test skipped stay set; the run
+  // order kept with the flags turns them into NA when unpacked. On equal
+  // rank, per-record tests go first, cheapest first.
+  std::stable_sort(steps.begin(), steps.end(), [](const CleaningTest& a, const CleaningTest& b) {
+    if (a.rank != b.rank) return a.rank < b.rank;
+    bool a_record = (bool) a.per_record, b_record = (bool) b.per_record;
+    if (a_record != b_record) return a_record;
+    return a_record && a.cost < b.cost;
+  });
+
+  std::vector<int> active(n);
+  for (int i = 0; i < n; i++) active[i] = i;
+  std::vector<int> sub_flags;
+  std::vector<int> run_order;
+
+  int n_steps = (int) steps.size();
+  CharacterVector plan_test(n_steps);
+  NumericVector plan_cost(n_steps), plan_pass_rate(n_steps), plan_expected(n_steps);
+  NumericVector plan_records(n_steps), plan_seconds(n_steps);
+  double expected = n;
+
+  for (int t = 0; t < n_steps; t++) {
+    const CleaningTest& step = steps[t];
+    int m = (int) active.size();
+    run_order.push_back(step.column);
+
+    plan_test[t] = step.name;
+    plan_cost[t] = step.cost;
+    plan_pass_rate[t] = step.pass_rate;
+    plan_expected[t] = plan ? expected : NA_REAL;
+    plan_records[t] = m;
+    if (!ISNAN(step.pass_rate)) expected *= step.pass_rate;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    if (m < n) {
+      if (m > 0) {
+        run_rows(step, active, nthreads, sub_flags);
+        for (int k = 0; k < m; k++) {
+          if (!sub_flags[k]) flags.clear(step.column, active[k]);
+        }
+      }
+    } else {
+      run_all(step);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    plan_seconds[t] = elapsed.count();
+
+    // Keep only the records this test left clean
+    int kept = 0;
+    for (int k = 0; k < m; k++) {
+      int row = active[k];
+      if (flags.get(step.column, row)) active[kept++] = row;
+    }
+    active.resize(kept);
+  }
+
+  flags.set_order(run_order);
+
+  // Return results and summary, with the order the tests ran in if planned
+  if (!plan) {
+    return flag_results(flags, output);
+  }
+  DataFrame plan_info = DataFrame::create(
+    Named("test") = plan_test,
+    Named("cost_per_record") = plan_cost,
+    Named("pass_rate") = plan_pass_rate,
+    Named("expected_records") = plan_expected,
+    Named("records") = plan_records,
+    Named("seconds") = plan_seconds,
+    Named("stringsAsFactors") = false
   );
+  return flag_results(flags, output, plan_info);
 }